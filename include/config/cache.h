@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+
+namespace dark::cache {
+
+enum class Policy {
+    LRU,    // Least recently used
+    PLRU,   // Tree pseudo-LRU, one bit per node
+    Random, // Pseudo-random, with a fixed seed
+    FIFO,   // First filled, first evicted
+};
+
+/* Parameters of one level of the data cache. */
+struct Level {
+    std::size_t size; // Bytes in total
+    std::size_t ways; // Lines in each set
+    std::size_t line; // Bytes in each line
+    Policy policy;
+    bool write_back;     // Otherwise write-through
+    bool write_allocate; // Fill the line on a store miss
+    // Cycles taken by a hit. If unset, the weights of CacheLoad/CacheStore are used.
+    std::optional<std::size_t> latency;
+};
+
+} // namespace dark::cache
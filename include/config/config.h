@@ -11,6 +11,14 @@ namespace weight {
 struct Counter;
 } // namespace weight
 
+namespace cache {
+struct Level;
+} // namespace cache
+
+namespace predictor {
+enum class Kind;
+} // namespace predictor
+
 struct Config {
 public:
     using unique_t = derival_ptr<Config>;
@@ -27,6 +35,9 @@ public:
 
     auto has_option(std::string_view) const -> bool;
     auto get_weight() const -> const weight::Counter &;
+    auto get_cache_levels() const -> std::span<const cache::Level>;
+    auto get_icache_level() const -> const cache::Level &;
+    auto get_predictor() const -> predictor::Kind;
 
 private:
     struct Impl;
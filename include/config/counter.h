@@ -38,6 +38,10 @@ register_class(Jalr, 2, "jalr");
 register_class(PredictTaken, 2, "");
 register_class(CacheLoad, 4, "");
 register_class(CacheStore, 4, "");
+register_class(ICacheMiss, 64, "");
+register_class(TargetMiss, 8, "");
+register_class(Stall, 1, "");
+register_class(Flush, 2, "");
 
 #undef register_class
 
@@ -45,6 +49,7 @@ struct Counter
     : tagged<
           CounterArith, CounterUpper, CounterCompare, CounterShift, CounterBitwise, CounterBranch,
           CounterLoad, CounterStore, CounterMultiply, CounterDivide, CounterJal, CounterJalr,
-          CounterPredictTaken, CounterCacheLoad, CounterCacheStore> {};
+          CounterPredictTaken, CounterCacheLoad, CounterCacheStore, CounterICacheMiss,
+          CounterTargetMiss, CounterStall, CounterFlush> {};
 
 } // namespace dark::weight
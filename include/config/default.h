@@ -1,4 +1,6 @@
 #pragma once
+#include "config/cache.h"
+#include "config/predictor.h"
 #include <string_view>
 
 namespace dark::config {
@@ -14,6 +16,41 @@ static constexpr std::string_view kInitStdout  = "<stdout>";
 static constexpr std::string_view kInitProfile = "<stderr>";
 static constexpr std::string_view kInitAnswer  = "test.ans";
 
+// The default data cache: 2 sets of 4 lines, 64 bytes each.
+static constexpr cache::Level kInitL1D = {
+    .size           = 512,
+    .ways           = 4,
+    .line           = 64,
+    .policy         = cache::Policy::LRU,
+    .write_back     = true,
+    .write_allocate = true,
+    .latency        = {},
+};
+
+// The instruction cache, only simulated with --icache.
+static constexpr cache::Level kInitL1I = {
+    .size           = 4 * 1024,
+    .ways           = 4,
+    .line           = 64,
+    .policy         = cache::Policy::LRU,
+    .write_back     = true,
+    .write_allocate = true,
+    .latency        = {},
+};
+
+// The second level, only simulated when --l2 is given.
+static constexpr cache::Level kInitL2 = {
+    .size           = 64 * 1024,
+    .ways           = 8,
+    .line           = 64,
+    .policy         = cache::Policy::LRU,
+    .write_back     = true,
+    .write_allocate = true,
+    .latency        = 12,
+};
+
+static constexpr predictor::Kind kInitPredictor = predictor::Kind::Bimodal;
+
 // clang-format off
 
 static constexpr std::string_view kSupportedOptions[] = {
@@ -21,9 +58,13 @@ static constexpr std::string_view kSupportedOptions[] = {
     "--detail",
     "--debug",
     "--cache",
+    "--icache",
     "--predictor",
+    "--btb",
+    "--pipeline",
     "--all",
     "--oj-mode",
+    "--predecode",
 };
 
 static constexpr std::initializer_list <std::string_view> kInitAssemblyFiles = {
@@ -43,10 +84,20 @@ Options:
                                     Conflicts with --silent.
   --debug                           Use built-in gdb.
   --cache                           Enable cache simulation.
+                                    The cache levels can be set by --l1d and --l2.
+  --icache                          Enable instruction cache simulation.
+                                    The cache can be set by --l1i.
   --predictor                       Enable branch predictor simulation.
+                                    The predictor can be set by --bp.
+  --btb                             Enable jump target prediction for jal and jalr,
+                                    with a branch target buffer and a return address stack.
+  --pipeline                        Enable the in-order pipeline model, which charges
+                                    stalls on data hazards and flushes on taken jumps.
   --all                             Enable all optimizations.
                                     Equivalent to --cache --predictor.
   --oj-mode                         Settings for the online judge.
+  --predecode                       Decode the whole text section in parallel
+                                    before running, instead of on first use.
 
 Configurations:
   --<option>                        Enable a specific option (see above).
@@ -56,6 +107,32 @@ Configurations:
                                     The name can be either an opcode name or a group name.
                                     - Example: -wload=100 -wbranch=3
 
+  --l1d=<key>=<value>,...           Set the first level of the data cache.
+  --l2=<key>=<value>,...            Add a second level to the data cache.
+                                    Only used with --cache. Keys are:
+                                      size:     bytes in total, with K/M suffix
+                                      ways:     lines in each set
+                                      line:     bytes in each line
+                                      policy:   lru, plru, random or fifo
+                                      write:    back or through
+                                      allocate: on or off (on a store miss)
+                                      latency:  cycles of a hit
+                                    The L1D defaults to size=512,ways=4,line=64,policy=lru,
+                                    write=back,allocate=on, and its hits cost the weights
+                                    of CacheLoad and CacheStore unless latency is set.
+                                    The L2 defaults to size=64K,ways=8,line=64,policy=lru,
+                                    write=back,allocate=on,latency=12.
+                                    - Example: --l1d=size=32K,ways=8,policy=plru --l2=size=256K
+
+  --bp=<kind>                       Set the branch predictor. Only used with --predictor.
+                                    The kind is one of bimodal, gshare, tournament or tage,
+                                    default bimodal.
+
+  --l1i=<key>=<value>,...           Set the instruction cache. Only used with --icache.
+                                    Keys are size, ways, line and policy, as above.
+                                    It defaults to size=4K,ways=4,line=64,policy=lru.
+                                    Each miss costs the weight of ICacheMiss.
+
   -t=<time>, --time=<time>          Set maximum instructions for the simulator.
                                     Note that this time is measured by instructions, not cycles.
 
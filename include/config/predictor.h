@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+
+namespace dark::predictor {
+
+/* The direction predictor of conditional branches. */
+enum class Kind {
+    Bimodal,    // 2-bit counters, indexed by pc
+    Gshare,     // 2-bit counters, indexed by pc and the global history
+    Tournament, // Bimodal and gshare, with a chooser for each pc
+    Tage,       // A bimodal base, and tagged tables of longer and longer history
+};
+
+/* How the target of a jal or jalr is predicted. */
+enum class Jump : std::uint8_t {
+    Other,  // By the branch target buffer
+    Call,   // Also pushes the return address, as rd is ra
+    Return, // By the return address stack, as jalr zero, 0(ra)
+};
+
+} // namespace dark::predictor
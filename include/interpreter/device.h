@@ -1,5 +1,6 @@
 #pragma once
 #include "config/counter.h"
+#include "config/predictor.h"
 #include "declarations.h"
 #include "utility/deleter.h"
 #include <cstddef>
@@ -30,12 +31,31 @@ public:
     std::istream &in;
     std::ostream &out;
 
+    /* Timing models that need a hook in the handlers or the blocks, fixed once created. */
+    struct Model {
+        bool cache;
+        bool predictor;
+        bool target;
+        bool pipeline;
+    };
+
+    /* A block of commands, run as a whole for some times. */
+    struct Block {
+        target_size_t pc;
+        target_size_t length;
+        std::size_t times;
+    };
+
     static auto create(const Config &config) -> unique_t;
+    auto get_model() const -> Model;
+    void add_block(Block, const weight::Counter &);
     void predict(target_size_t pc, bool result);
+    void jump(target_size_t pc, target_size_t target, predictor::Jump kind);
     void print_details(bool) const;
 
     void try_load(target_size_t low, target_size_t size);
     void try_store(target_size_t low, target_size_t size);
+    void fetch(target_size_t pc, target_size_t count);
 
 private:
     struct Impl;
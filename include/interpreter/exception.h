@@ -23,6 +23,7 @@ enum class Error : std::uint8_t {
 
     DivideByZero, // division or modulo by zero
     OutOfMemory,  // heap overflow
+    StackOverflow, // access just below the stack
 
     NotImplemented,
 };
@@ -16,17 +16,89 @@ public:
     static_assert(std::same_as<_Func_t, Function_t>);
 
     struct MetaData {
-        struct PackData;
+        // Operands of each command shape, see simulation/executable.h
+        struct RType;
+        struct IType;
+        struct SType;
+        struct UType;
+        using BType = SType;
+        using JType = UType;
+
+        // Whether the command is fused with the next one, see compile_block.
+        enum class Fusion : std::uint8_t {
+            None,     // A single command.
+            Straight, // Falls through to the command after next.
+            Control,  // The next command is a branch/jalr, which ends the block.
+        };
+
         Register rd{};
         Register rs1{};
         Register rs2{};
+        Fusion fusion{};
         std::uint32_t imm{};
-        auto parse(RegisterFile &) const -> PackData;
+
+        auto parse_r(RegisterFile &) const -> RType;
+        auto parse_i(RegisterFile &) const -> IType;
+        auto parse_s(RegisterFile &) const -> SType;
+        auto parse_u(RegisterFile &) const -> UType;
     };
 
 private:
     static_assert(sizeof(_Func_t *) == sizeof(std::size_t));
 
+#if defined(REIMU_COMPACT_EXECUTABLE)
+    /**
+     * Compact layout: 8 bytes per command, so twice as many fit in a cache line.
+     * The function pointer is moved to a side table shared by all commands,
+     * and only its index is kept in hand, together with the packed operands.
+     */
+    static constexpr std::size_t kIndexBits = 12;
+
+    inline static _Func_t *table[1 << kIndexBits] = {fn};
+
+    std::uint32_t index : kIndexBits = 0;
+    std::uint32_t rd : 5             = 0;
+    std::uint32_t rs1 : 5            = 0;
+    std::uint32_t rs2 : 5            = 0;
+    std::uint32_t fusion : 2         = 0;
+    std::uint32_t imm                = 0;
+
+    /* Register the function in the side table, return its index. Thread-safe. */
+    static auto index_of(_Func_t *func) -> std::uint32_t;
+
+public:
+    constexpr explicit Executable() = default;
+    explicit Executable(_Func_t *func, MetaData meta) { this->set_handle(func, meta); }
+
+    Executable(const Executable &)            = delete;
+    Executable &operator=(const Executable &) = delete;
+
+    void set_handle(_Func_t *func, MetaData meta) {
+        this->index  = index_of(func);
+        this->rd     = reg_to_int(meta.rd);
+        this->rs1    = reg_to_int(meta.rs1);
+        this->rs2    = reg_to_int(meta.rs2);
+        this->fusion = static_cast<std::uint32_t>(meta.fusion);
+        this->imm    = meta.imm;
+    }
+
+    auto operator()(RegisterFile &rf, Memory &mem, Device &dev) {
+        return table[this->index](*this, rf, mem, dev);
+    }
+
+    auto get_meta() const -> MetaData {
+        return {
+            .rd     = int_to_reg(this->rd),
+            .rs1    = int_to_reg(this->rs1),
+            .rs2    = int_to_reg(this->rs2),
+            .fusion = static_cast<MetaData::Fusion>(this->fusion),
+            .imm    = this->imm,
+        };
+    }
+
+    auto get_func() const { return table[this->index]; }
+
+#else  // !REIMU_COMPACT_EXECUTABLE
     _Func_t *func = fn; // Function pointer.
     MetaData meta = {}; // Some in hand data.
 
@@ -48,6 +120,9 @@ public:
 
     auto &get_meta() const { return this->meta; }
 
+    auto get_func() const { return this->func; }
+#endif // REIMU_COMPACT_EXECUTABLE
+
     /* Return the hint for the next command.  */
     auto next(target_size_t n = 4) -> Hint {
         static_assert(
@@ -57,4 +132,8 @@ public:
     }
 };
 
+#if defined(REIMU_COMPACT_EXECUTABLE)
+static_assert(sizeof(Executable) == 8, "The compact layout must take 8 bytes.");
+#endif // REIMU_COMPACT_EXECUTABLE
+
 } // namespace dark
@@ -16,6 +16,7 @@ private:
     const Config &config;
     any assembly_layout;
     any memory_layout;
+    any memory_image;
 };
 
 } // namespace dark
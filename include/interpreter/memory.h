@@ -2,6 +2,7 @@
 #include "declarations.h"
 #include "interpreter/forward.h"
 #include "utility/deleter.h"
+#include <memory>
 #include <span>
 
 namespace dark {
@@ -13,7 +14,10 @@ private:
     using unique_t = dark::derival_ptr<Memory>;
 
 public:
-    static auto create(const Config &, const MemoryLayout &) -> unique_t;
+    // The initial memory image, built once and shared by all the runs.
+    struct Image;
+    static auto snapshot(const MemoryLayout &) -> std::shared_ptr<const Image>;
+    static auto create(const Config &, const MemoryLayout &, const Image &) -> unique_t;
 
     auto load_i8(target_size_t addr) -> std::int8_t;
     auto load_i16(target_size_t addr) -> std::int16_t;
@@ -36,6 +40,21 @@ public:
     // For libc functions.
     auto libc_access(target_size_t) -> std::span<char>;
 
+    // For bulk access, with the whole range checked at once.
+    // Null (or false) if any byte of it is out of bound.
+    auto read_range(target_size_t addr, target_size_t size) -> const char *;
+    auto write_range(target_size_t addr, target_size_t size) -> char *;
+    bool copy_range(target_size_t dst, target_size_t src, target_size_t size);
+
+    // Memory-mapped I/O, for addresses out of all the normal areas.
+    struct Mapped {
+        // Offset is from the start of the mapped range.
+        virtual auto load(target_size_t offset, target_size_t size) -> target_size_t = 0;
+        virtual void store(target_size_t offset, target_size_t size, target_size_t value) = 0;
+        virtual ~Mapped() = default;
+    };
+    void map_device(target_size_t addr, target_size_t size, Mapped &);
+
     // For ICache.
     auto get_text_range() -> Interval;
 
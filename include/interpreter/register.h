@@ -12,6 +12,10 @@ private:
     target_size_t pc;
     target_size_t new_pc;
 
+#if defined(REIMU_THREADED_DISPATCH)
+    target_size_t chain = 0; // Commands left to chain in current dispatch.
+#endif
+
     static constexpr target_size_t end_pc = 0x4;
 
 public:
@@ -32,6 +36,31 @@ public:
         (*this)[Register::zero] = 0;
         return this->pc != this->end_pc;
     }
+    /* Complete after n straight-line instructions, without checking the end. */
+    void advance_by(target_size_t n) {
+        this->pc += n * sizeof(command_size_t);
+        this->new_pc            = this->pc + sizeof(command_size_t);
+        (*this)[Register::zero] = 0;
+    }
+#if defined(REIMU_THREADED_DISPATCH)
+    /* Chain at most n more straight-line instructions in this dispatch. */
+    void set_chain(target_size_t n) { this->chain = n; }
+    /* Whether to chain the next instruction directly. */
+    bool chain_next() {
+        if (this->chain == 0)
+            return false;
+        this->chain -= 1;
+        (*this)[Register::zero] = 0;
+        return true;
+    }
+    /* Consume one more instruction from the chain, used by fused commands. */
+    void chain_skip() { this->chain -= 1; }
+    /* Move back to the instruction where the chain was broken. */
+    void rewind_chain() {
+        this->pc -= this->chain * sizeof(command_size_t);
+        this->chain = 0;
+    }
+#endif
     /* Print register details. */
     void print_details(bool) const;
     /* Psuedo start pc (pretend there's a call at get_start_pc). */
@@ -82,29 +82,35 @@ static auto checked_get_string(Memory &mem, target_size_t str, std::size_t extra
 
 template <_Index index>
 static auto checked_get_area(Memory &mem, target_size_t ptr, target_size_t size) {
-    auto area = mem.libc_access(ptr);
+    auto *area = mem.write_range(ptr, size);
 
-    if (area.size() < size)
+    if (area == nullptr)
         handle_outofbound<index>(ptr + size, sizeof(char));
 
-    return area.data();
+    return area;
 }
 
 template <_Index index>
 static auto
-checked_get_areas(Memory &mem, target_size_t dst, target_size_t src, target_size_t size) {
-    auto area0 = mem.libc_access(dst);
-    auto area1 = mem.libc_access(src);
-
-    if (area0.size() < area1.size()) {
-        if (area0.size() < size)
-            handle_outofbound<index>(dst + size, sizeof(char));
-    } else {
-        if (area1.size() < size)
-            handle_outofbound<index>(src + size, sizeof(char));
-    }
-
-    return std::make_pair(area0.data(), area1.data());
+checked_get_areas(Memory &mem, target_size_t lhs, target_size_t rhs, target_size_t size) {
+    auto *area0 = mem.read_range(lhs, size);
+    auto *area1 = mem.read_range(rhs, size);
+
+    if (area0 == nullptr)
+        handle_outofbound<index>(lhs + size, sizeof(char));
+    if (area1 == nullptr)
+        handle_outofbound<index>(rhs + size, sizeof(char));
+
+    return std::make_pair(area0, area1);
+}
+
+template <_Index index>
+static void checked_copy(Memory &mem, target_size_t dst, target_size_t src, target_size_t size) {
+    if (mem.copy_range(dst, src, size)) [[likely]]
+        return;
+
+    const auto bad = mem.write_range(dst, size) == nullptr ? dst : src;
+    handle_outofbound<index>(bad + size, sizeof(char));
 }
 
 [[maybe_unused]]
@@ -9,6 +9,8 @@ namespace dark {
 struct MemoryLayout {
     // A table that maps the symbol to its final position.
     std::unordered_map<std::string, target_size_t> position_table;
+    // The same for the symbols local to a file, which may share a name.
+    std::unordered_multimap<std::string, target_size_t> local_table;
 
     // A table which indicates the storage at given position.
     // The vector should be 4 bytes aligned at least.
@@ -8,49 +8,283 @@
 #include "linker/layout.h"
 #include "utility/error.h"
 #include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <fcntl.h>
+#include <optional>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <vector>
 
+#if defined(REIMU_GUARD_PAGES)
+#include <csignal>
+#endif
+
 namespace dark {
 
 namespace {
 
+#if defined(REIMU_GUARD_PAGES)
+
+/* Thrown by the signal handler, when the guest touches a guard page. */
+struct GuardFault {};
+
+/**
+ * Turn a fault inside the guest space into a GuardFault. Memory accesses
+ * are compiled with -fnon-call-exceptions, so it can be thrown right from
+ * the faulting instruction. Any other fault is a real crash.
+ */
+std::byte *guard_low  = nullptr;
+std::byte *guard_high = nullptr;
+
+void guard_handler(int sig, siginfo_t *info, void *) {
+    auto *addr = static_cast<std::byte *>(info->si_addr);
+    if (guard_low <= addr && addr < guard_high)
+        throw GuardFault{};
+    ::signal(sig, SIG_DFL);
+    ::raise(sig);
+}
+
+#endif // REIMU_GUARD_PAGES
+
+/**
+ * The whole guest address space, reserved as one host mapping.
+ * Nothing is accessible until committed, so that any guest address
+ * maps to the host by a plain offset from the base.
+ *
+ * With guard pages, the mapping covers all the 32-bit space (and then
+ * some), so that any access out of the committed pages faults.
+ */
+struct GuestSpace {
+private:
+    static constexpr target_size_t kPageSize = 1 << 12;
+
+    const std::size_t size;
+    std::byte *const host;
+#if defined(REIMU_GUARD_PAGES)
+    struct sigaction old_segv {}; // Restored when the space is gone
+    struct sigaction old_bus {};
+#endif
+
+    static auto reserve(std::size_t size) -> std::byte * {
+        constexpr auto kFlags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+        auto *ptr             = ::mmap(nullptr, size, PROT_NONE, kFlags, -1, 0);
+        if (ptr == MAP_FAILED)
+            panic("Failed to reserve {} bytes of memory for the program.", size);
+        return static_cast<std::byte *>(ptr);
+    }
+
+    static auto reserved_size([[maybe_unused]] const Config &config) -> std::size_t {
+#if defined(REIMU_GUARD_PAGES)
+        return (std::size_t{1} << 32) + kPageSize;
+#else
+        return config.get_stack_top();
+#endif
+    }
+
+    void protect(target_size_t lo, target_size_t hi, int prot) {
+        lo = lo & ~(kPageSize - 1);
+        runtime_assert(lo <= hi && hi <= this->size);
+        runtime_assert(::mprotect(this->host + lo, hi - lo, prot) == 0);
+    }
+
+public:
+    explicit GuestSpace(const MemoryLayout &, const Config &config) :
+        size(reserved_size(config)), host(reserve(size)) {
+#if defined(REIMU_GUARD_PAGES)
+        guard_low  = this->host;
+        guard_high = this->host + this->size;
+
+        struct sigaction action {};
+        action.sa_sigaction = guard_handler;
+        action.sa_flags     = SA_SIGINFO | SA_NODEFER; // Never returns, so no mask is restored.
+        sigemptyset(&action.sa_mask);
+        runtime_assert(::sigaction(SIGSEGV, &action, &this->old_segv) == 0);
+        runtime_assert(::sigaction(SIGBUS, &action, &this->old_bus) == 0);
+#endif
+    }
+    GuestSpace(const GuestSpace &)            = delete;
+    GuestSpace &operator=(const GuestSpace &) = delete;
+    ~GuestSpace() {
+#if defined(REIMU_GUARD_PAGES)
+        ::sigaction(SIGSEGV, &this->old_segv, nullptr);
+        ::sigaction(SIGBUS, &this->old_bus, nullptr);
+        guard_low  = nullptr;
+        guard_high = nullptr;
+#endif
+        ::munmap(this->host, this->size);
+    }
+
+    static auto page_up(target_size_t addr) -> target_size_t {
+        return (addr + kPageSize - 1) & ~(kPageSize - 1);
+    }
+    static auto page_down(target_size_t addr) -> target_size_t { return addr & ~(kPageSize - 1); }
+
+    auto get_host(target_size_t addr) const -> std::byte * { return this->host + addr; }
+
+    /* Make the pages covering [lo, hi) readable and writable. */
+    void commit(target_size_t lo, target_size_t hi) {
+        this->protect(lo, hi, PROT_READ | PROT_WRITE);
+    }
+
+    /* Map the pages of [lo, hi) to the given file, privately, so they are copied on write. */
+    void map(target_size_t lo, target_size_t hi, int fd) {
+        runtime_assert(lo % kPageSize == 0 && lo <= hi && hi <= this->size);
+        constexpr auto kFlags = MAP_PRIVATE | MAP_FIXED;
+        auto *ptr = ::mmap(this->host + lo, hi - lo, PROT_READ | PROT_WRITE, kFlags, fd, 0);
+        runtime_assert(ptr == this->host + lo);
+    }
+
+    /* Make the pages below hi read only, from the one covering lo. */
+    void seal(target_size_t lo, target_size_t hi) {
+        lo = lo & ~(kPageSize - 1);
+        hi = hi & ~(kPageSize - 1);
+        if (lo < hi)
+            this->protect(lo, hi, PROT_READ);
+    }
+
+    /* Make [lo, hi) read as zero. Whole pages in it are given back to the host. */
+    void discard(target_size_t lo, target_size_t hi) {
+        const auto first = std::min(page_up(lo), hi);
+        const auto last  = std::max(first, hi & ~(kPageSize - 1));
+        std::fill(this->host + lo, this->host + first, std::byte{});
+        if (first < last)
+            runtime_assert(::madvise(this->host + first, last - first, MADV_DONTNEED) == 0);
+        std::fill(this->host + last, this->host + hi, std::byte{});
+    }
+
+    /* Make the pages covering [lo, hi) inaccessible again. */
+    void decommit(target_size_t lo, target_size_t hi) { this->protect(lo, hi, PROT_NONE); }
+
+    struct PageUsage {
+        target_size_t touched; // Pages present in the host.
+        target_size_t dirty;   // Pages written, owned by this run only.
+        target_size_t lowest;  // Address of the lowest touched page.
+    };
+
+    /**
+     * Count the pages covering [lo, hi) by the host page table, which tracks
+     * them for free, so nothing is paid on each access. A page is touched once
+     * present, and dirty once it is a private copy, i.e. neither the shared
+     * zero page nor a clean page of the static image.
+     */
+    auto scan(target_size_t lo, target_size_t hi) const -> std::optional<PageUsage> {
+        constexpr auto kPresent   = std::uint64_t{1} << 63;
+        constexpr auto kFile      = std::uint64_t{1} << 61;
+        constexpr auto kExclusive = std::uint64_t{1} << 56;
+
+        lo = page_down(lo);
+        hi = page_up(hi);
+        if (::sysconf(_SC_PAGESIZE) != kPageSize)
+            return std::nullopt;
+
+        const int fd = ::open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return std::nullopt;
+
+        std::vector<std::uint64_t> entries((hi - lo) / kPageSize);
+        const auto bytes  = entries.size() * sizeof(std::uint64_t);
+        const auto offset = std::bit_cast<std::uintptr_t>(this->host + lo) / kPageSize;
+        const auto result = ::pread(fd, entries.data(), bytes, offset * sizeof(std::uint64_t));
+        ::close(fd);
+        if (result != static_cast<ssize_t>(bytes))
+            return std::nullopt;
+
+        auto usage = PageUsage{.touched = 0, .dirty = 0, .lowest = hi};
+        for (std::size_t i = entries.size(); i-- > 0;) {
+            const auto entry = entries[i];
+            if ((entry & kPresent) == 0)
+                continue;
+            usage.touched += 1;
+            usage.dirty += (entry & kFile) == 0 && (entry & kExclusive) != 0;
+            usage.lowest = lo + i * kPageSize;
+        }
+        return usage;
+    }
+};
+
+/**
+ * The initial static area (text, data, rodata and bss), built once into
+ * an anonymous file. Each run maps it copy-on-write, so that setting up a
+ * run only costs a few page faults instead of a full copy, and the pages
+ * never written (e.g. the text) are shared by all the runs.
+ */
+struct StaticImage {
+private:
+    const target_size_t lo;
+    const target_size_t hi;
+    const int fd;
+
+    static auto create_file(std::size_t size) -> int {
+        const int fd = ::memfd_create("reimu-static", MFD_CLOEXEC);
+        if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(size)) != 0)
+            panic("Failed to create the static image of {} bytes.", size);
+        return fd;
+    }
+
+public:
+    explicit StaticImage(const MemoryLayout &layout) :
+        lo(GuestSpace::page_down(layout.text.begin())),
+        hi(GuestSpace::page_up(layout.bss.end())), fd(create_file(hi - lo)) {
+        auto *ptr = ::mmap(nullptr, hi - lo, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        runtime_assert(ptr != MAP_FAILED);
+        auto *base         = static_cast<std::byte *>(ptr) - this->lo;
+        constexpr auto __copy = [](std::byte *base, const auto &section) {
+            std::ranges::copy(section.storage, base + section.begin());
+        };
+        __copy(base, layout.text);
+        __copy(base, layout.data);
+        __copy(base, layout.rodata);
+        __copy(base, layout.bss);
+        ::munmap(ptr, hi - lo);
+    }
+    StaticImage(const StaticImage &)            = delete;
+    StaticImage &operator=(const StaticImage &) = delete;
+    ~StaticImage() { ::close(this->fd); }
+
+    void map_into(GuestSpace &space) const { space.map(this->lo, this->hi, this->fd); }
+};
+
 struct StaticArea {
 private:
     const Interval text;
     const Interval data;
-    std::byte *const storage;
 
 public:
-    explicit StaticArea(const MemoryLayout &layout, const Config &) :
+    explicit StaticArea(
+        const MemoryLayout &layout, const Config &, GuestSpace &space, const StaticImage &image
+    ) :
         text({layout.text.begin(), layout.text.end()}),
-        data({layout.data.begin(), layout.bss.end()}),
-        storage(new std::byte[data.finish - text.start]{} - text.start) {
+        data({layout.data.begin(), layout.bss.end()}) {
         runtime_assert(text.start == libc::kLibcEnd);
-        constexpr auto __copy = [](StaticArea *area, const auto &section) {
-            std::ranges::copy(section.storage, area->get_static(section.begin()));
-        };
-        __copy(this, layout.text);
-        __copy(this, layout.data);
-        __copy(this, layout.rodata);
-        __copy(this, layout.bss);
+        image.map_into(space);
+#if defined(REIMU_GUARD_PAGES)
+        space.seal(text.start, data.start); // Data starts on a fresh page, see Linker::link.
+#endif
     }
     bool in_text(target_size_t pc) const {
         return this->text.start <= pc && pc < this->text.finish;
     }
     bool in_data(target_size_t lo, target_size_t hi) const { return this->data.contains(lo, hi); }
-    auto get_static(target_size_t addr) -> std::byte * { return this->storage + addr; }
     auto get_range() const -> Interval { return {this->text.start, this->data.finish}; }
     auto get_text_range() const { return this->text; }
     auto get_data_range() const { return this->data; }
-    ~StaticArea() { delete (this->storage + this->text.start); }
 };
 
+/**
+ * The band right below the stack, never given to the heap nor committed,
+ * so that the stack running out is caught before it reaches the heap.
+ */
+static constexpr target_size_t kGuardSize = 64 << 10;
+
 struct HeapArea {
 private:
-    std::vector<std::byte> storage;
+    GuestSpace &space;
     const target_size_t heap_start;
     const target_size_t heap_capacity;
     target_size_t heap_finish;
+    target_size_t heap_commit; // Pages up to here are committed
+    target_size_t heap_peak;   // The highest end ever reached
     // Our implementation require that the end of static area
     // should not overlap with the start of heap area
     // So, we need to choose the next page even if already aligned
@@ -59,25 +293,37 @@ private:
         return (addr & ~(kPageSize - 1)) + kPageSize;
     }
 
-    static auto checked_diff(target_size_t a, target_size_t b) -> target_size_t {
-        runtime_assert(a < b);
-        return b - a;
+    // No room at all is reported by Memory::create, with a hint.
+    static auto room_below(target_size_t start, target_size_t stack_low) -> target_size_t {
+        const auto limit = stack_low > kGuardSize ? stack_low - kGuardSize : 0;
+        return start < limit ? limit - start : 0;
     }
 
 public:
-    explicit HeapArea(const MemoryLayout &layout, const Config &config) :
-        heap_start(next_page(layout.bss.end())),
-        heap_capacity(checked_diff(heap_start, config.get_stack_low())), heap_finish(heap_start) {}
+    /**
+     * Pages are given by the host lazily, on their first touch, as zero.
+     * So the whole capacity is committed at once, and growing the heap
+     * only moves the end. With guard pages, only the pages in use are
+     * committed, so that any access past them faults. Either way, the
+     * heap never reaches the guard band below the stack.
+     */
+    explicit HeapArea(const MemoryLayout &layout, const Config &config, GuestSpace &space) :
+        space(space), heap_start(next_page(layout.bss.end())),
+        heap_capacity(room_below(heap_start, config.get_stack_low())), heap_finish(heap_start),
+        heap_commit(heap_start), heap_peak(heap_start) {
+#if !defined(REIMU_GUARD_PAGES)
+        this->heap_commit = this->heap_start + this->heap_capacity;
+        this->space.commit(this->heap_start, this->heap_commit);
+#endif
+    }
 
     bool in_heap(target_size_t lo, target_size_t hi) const {
         return this->heap_start <= lo && hi <= this->heap_finish;
     }
-    auto *get_heap(target_size_t addr) { return this->storage.data() - this->heap_start + addr; }
     auto get_range() const -> Interval { return {this->heap_start, this->heap_finish}; }
+    auto get_peak() const -> target_size_t { return this->heap_peak; }
     auto grow(target_ssize_t size) -> std::pair<char *, target_size_t> {
-        /// TODO: remove this useless check
         const auto old_size = this->heap_finish - this->heap_start;
-        runtime_assert(old_size == this->storage.size());
 
         if (old_size + size > this->heap_capacity)
             throw FailToInterpret{
@@ -91,31 +337,52 @@ public:
 
         const auto retval = this->heap_finish;
         this->heap_finish += size;
-        const auto new_size = old_size + size;
+        this->heap_peak = std::max(this->heap_peak, this->heap_finish);
 
-        // To avoid too many reallocations, we reserve to the next power of 2
-        if (size > 0)
-            this->storage.reserve(std::bit_ceil(new_size));
-        this->storage.resize(new_size);
+        if (this->heap_finish > this->heap_commit) {
+            this->heap_commit = GuestSpace::page_up(this->heap_finish);
+            this->space.commit(retval, this->heap_commit);
+        } else if (size < 0) {
+            // Memory given back must read as zero when it is grown again.
+            this->space.discard(this->heap_finish, retval);
+#if defined(REIMU_GUARD_PAGES)
+            const auto top = GuestSpace::page_up(this->heap_finish);
+            if (top < this->heap_commit) {
+                this->space.decommit(top, this->heap_commit);
+                this->heap_commit = top;
+            }
+#endif
+        }
 
-        return std::make_pair(std::bit_cast<char *>(this->get_heap(retval)), retval);
+        return std::make_pair(std::bit_cast<char *>(this->space.get_host(retval)), retval);
     }
 };
 
 struct StackArea {
 private:
     const Interval stack;
-    std::byte *const storage;
 
 public:
-    explicit StackArea(const MemoryLayout &, const Config &config) :
-        stack({config.get_stack_low(), config.get_stack_top()}),
-        storage(new std::byte[stack.finish - stack.start]{} - stack.start) {}
+    explicit StackArea(const MemoryLayout &, const Config &config, GuestSpace &space) :
+        stack({config.get_stack_low(), config.get_stack_top()}) {
+        space.commit(stack.start, stack.finish);
+    }
 
     bool in_stack(target_size_t lo, target_size_t hi) const { return this->stack.contains(lo, hi); }
-    auto *get_stack(target_size_t addr) { return this->storage + addr; }
+    /**
+     * Whether an access out of all the areas is in the guard band below the
+     * stack, and nearer to the stack than to the end of the heap, which is
+     * most likely the stack running out, e.g. by too deep a recursion. The
+     * rest of the band is left to the heap overrunning its end. It is only
+     * checked once an access is already out of bound, so it costs nothing
+     * on normal accesses.
+     */
+    bool in_guard(target_size_t addr, target_size_t heap_end) const {
+        if (addr >= this->stack.start || this->stack.start - addr > kGuardSize)
+            return false;
+        return this->stack.start - addr < addr - heap_end;
+    }
     auto get_range() const { return this->stack; }
-    ~StackArea() { delete (this->storage + this->stack.start); }
 };
 
 } // namespace
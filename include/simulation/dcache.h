@@ -1,121 +1,311 @@
 #pragma once
+#include "config/cache.h"
 #include "declarations.h"
 #include "utility/error.h"
+#include <algorithm>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
 
-namespace kupi {
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-using Addr_t = dark::target_size_t;
-using Time_t = std::size_t;
+namespace dark::cache {
 
-static constexpr Addr_t CacheLineSize  = 64;
-static constexpr Addr_t CacheMaxSize   = 4; // 每个组中的缓存行数
-static constexpr Addr_t CacheGroupSize = 2; // 缓存组数
+using Addr_t = target_size_t;
 
-struct CacheLine {
-    Addr_t id{};
-    bool valid{};
-    bool dirty{};
-    Time_t timestamp{};
-
-    void update(Addr_t new_id, Time_t cur_timestamp) {
-        this->id        = new_id;
-        this->valid     = true;
-        this->dirty     = false;
-        this->timestamp = cur_timestamp;
-    }
+/* Accesses seen by one level. Only hits are charged at its latency. */
+struct Stats {
+    std::size_t load_hit;
+    std::size_t load_miss;
+    std::size_t store_hit;
+    std::size_t store_miss;
 };
 
-struct CacheCounter {
-    Time_t count_load_real{};
-    Time_t count_write_back{};
-};
-
-class CacheGroup {
+/**
+ * One level of a set-associative cache. It only keeps the tags,
+ * since the data is always read from and written to the memory.
+ *
+ * The tags of a set are kept together, and compared several at once.
+ * The replacement state takes no time stamps:
+ * - LRU: an age matrix of each set, one row of bits for each way,
+ *   where bit j of row i is set iff way i is used later than way j.
+ * - PLRU: a tree of bits of each set.
+ * - FIFO: the next way to fill of each set.
+ */
+class Storage {
 public:
-    explicit CacheGroup() = default;
-
-    bool load(Addr_t low, Addr_t high, CacheCounter &counter) {
-        ++cur_timestamp;
-        auto line_id = low / CacheLineSize;
-        auto lineLow = low / CacheLineSize * CacheLineSize;
-        if (lineLow + CacheLineSize < high)
-            dark::unreachable("CacheGroup::load address range too large");
-        if (this->check_hit(line_id, false))
-            return true;
-        this->allocate_one(line_id, counter);
-        return false;
+    explicit Storage(const Level &level) :
+        level(level),
+        shift(std::countr_zero(level.line)),
+        sets(level.size / (level.ways * level.line)),
+        ways(level.ways),
+        stride((level.ways + kLanes - 1) / kLanes * kLanes),
+        full(~std::uint64_t(0) >> (64 - level.ways)),
+        tags(make_tags(this->sets, this->ways, this->stride)),
+        dirty(this->sets * this->stride),
+        order(make_order(level, this->sets)) {}
+
+    /* Look up the line of the address, and mark it dirty if asked on a hit. */
+    bool access(Addr_t addr, bool write) {
+        const auto [set, tag] = this->split(addr);
+        const auto way        = this->find(set, tag);
+        if (way == this->ways)
+            return false;
+        if (write)
+            this->dirty[set * this->stride + way] = true;
+        this->touch(set, way);
+        return true;
     }
 
-    bool store(Addr_t low, Addr_t high, CacheCounter &counter) {
-        ++cur_timestamp;
-        auto line_id = low / CacheLineSize;
-        auto lineLow = low / CacheLineSize * CacheLineSize;
-        if (lineLow + CacheLineSize < high)
-            dark::unreachable("CacheGroup::store address range too large");
-        if (this->check_hit(line_id, true))
-            return true;
-        this->allocate_one(line_id, counter);
-        return false;
+    /* Put the line of the address in. Return the dirty line evicted, if any. */
+    auto fill(Addr_t addr, bool write) -> std::optional<Addr_t> {
+        const auto [set, tag] = this->split(addr);
+        const auto way        = this->victim(set);
+        const auto which      = set * this->stride + way;
+        const auto old        = this->tags[which];
+        const auto evicted    = this->dirty[which] && old != kEmpty;
+
+        this->tags[which]  = tag;
+        this->dirty[which] = write;
+        this->touch(set, way);
+        if (this->level.policy == Policy::FIFO)
+            this->order[set] = (way + 1) % this->ways;
+
+        if (!evicted)
+            return std::nullopt;
+        return static_cast<Addr_t>(old << this->shift);
     }
 
+    const Level level;
+    Stats stats{};
+
 private:
-    Time_t cur_timestamp = 0;
-    CacheLine cache[CacheMaxSize];
-
-    void allocate_one(Addr_t id, CacheCounter &counter) {
-        CacheLine *min_line = &cache[0];
-        for (auto &line : cache) {
-            if (!line.valid)
-                return line.update(id, cur_timestamp);
-            if (line.timestamp < min_line->timestamp)
-                min_line = &line;
+    // No line number can be either, since a line is at least 4 bytes.
+    static constexpr Addr_t kEmpty   = static_cast<Addr_t>(-1);
+    static constexpr Addr_t kPadding = static_cast<Addr_t>(-2);
+    // Tags compared at once, and each set is padded to a multiple of it.
+    static constexpr std::size_t kLanes = 4;
+
+    const std::size_t shift; // log2 of the line size
+    const std::size_t sets;
+    const std::size_t ways;
+    const std::size_t stride;  // Ways with the padding, which never matches
+    const std::uint64_t full; // One bit for each way
+
+    // Flat arrays of [sets][stride].
+    std::vector<Addr_t> tags;
+    std::vector<std::uint8_t> dirty;
+
+    std::vector<std::uint64_t> order; // Replacement state, see above
+    std::uint64_t seed = 0x9e3779b97f4a7c15; // Fixed, so that runs are repeatable
+
+    // Up to 8 ways, the age matrix is packed in one word, a byte each row.
+    static constexpr std::size_t kPacked   = 8;
+    static constexpr std::uint64_t kColumn = 0x0101010101010101;
+
+    static auto make_tags(std::size_t sets, std::size_t ways, std::size_t stride)
+        -> std::vector<Addr_t> {
+        std::vector<Addr_t> tags(sets * stride, kEmpty);
+        for (std::size_t i = 0; i < sets; ++i)
+            std::fill(tags.begin() + i * stride + ways, tags.begin() + (i + 1) * stride, kPadding);
+        return tags;
+    }
+
+    static auto make_order(const Level &level, std::size_t sets) -> std::vector<std::uint64_t> {
+        if (level.policy != Policy::LRU)
+            return std::vector<std::uint64_t>(sets);
+        if (level.ways > kPacked)
+            return std::vector<std::uint64_t>(sets * level.ways);
+        // Rows of no way are never empty, so they are never picked.
+        // With all the 8 ways, there are none, and shifting by 64 is undefined.
+        const auto unused =
+            level.ways == kPacked ? std::uint64_t(0) : ~std::uint64_t(0) << (level.ways * kPacked);
+        return std::vector<std::uint64_t>(sets, unused);
+    }
+
+    struct Location {
+        std::size_t set;
+        Addr_t tag;
+    };
+
+    auto split(Addr_t addr) const -> Location {
+        // The whole line number is kept as the tag, for simplicity.
+        const auto tag = static_cast<Addr_t>(addr >> this->shift);
+        return {.set = tag & (this->sets - 1), .tag = tag};
+    }
+
+    /* The first way holding the tag, or ways if none. */
+    auto find(std::size_t set, Addr_t tag) const -> std::size_t {
+        const auto *first = this->tags.data() + set * this->stride;
+#if defined(__SSE2__)
+        const auto key = _mm_set1_epi32(static_cast<int>(tag));
+        for (std::size_t i = 0; i < this->stride; i += kLanes) {
+            const auto part = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first + i));
+            const auto mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(part, key)));
+            if (mask != 0)
+                return i + std::countr_zero(unsigned(mask));
         }
+#else
+        for (std::size_t i = 0; i < this->ways; ++i)
+            if (first[i] == tag)
+                return i;
+#endif
+        return this->ways;
+    }
 
-        counter.count_load_real += 1;
-        counter.count_write_back += min_line->dirty;
-        min_line->update(id, cur_timestamp);
+    void touch(std::size_t set, std::size_t way) {
+        switch (this->level.policy) {
+            case Policy::LRU: {
+                // Set the row of this way, then clear its column.
+                if (this->ways <= kPacked) {
+                    auto &bits = this->order[set];
+                    bits       = (bits | this->full << (way * kPacked)) & ~(kColumn << way);
+                    break;
+                }
+                auto *rows       = this->order.data() + set * this->ways;
+                const auto other = ~(std::uint64_t(1) << way);
+                rows[way]        = this->full;
+                for (std::size_t i = 0; i < this->ways; ++i)
+                    rows[i] &= other;
+                break;
+            }
+            case Policy::PLRU: {
+                // Each node points to the half to evict next, i.e. away from this way.
+                auto &bits       = this->order[set];
+                std::size_t node = 1;
+                for (std::size_t half = this->ways / 2; half != 0; half /= 2) {
+                    const bool right = (way & half) != 0;
+                    if (right)
+                        bits &= ~(std::uint64_t(1) << node);
+                    else
+                        bits |= std::uint64_t(1) << node;
+                    node = node * 2 + right;
+                }
+                break;
+            }
+            case Policy::Random:
+            case Policy::FIFO: break;
+            default:           unreachable();
+        }
     }
 
-    bool check_hit(Addr_t id, bool is_write) {
-        for (auto &line : cache) {
-            if (line.valid && line.id == id) {
-                line.timestamp = cur_timestamp;
-                line.dirty |= is_write;
-                return true;
+    auto victim(std::size_t set) -> std::size_t {
+        if (const auto way = this->find(set, kEmpty); way != this->ways)
+            return way;
+
+        switch (this->level.policy) {
+            case Policy::LRU: {
+                // The only way used before all the others has an empty row.
+                if (this->ways <= kPacked) {
+                    const auto bits = this->order[set];
+                    const auto zero = (bits - kColumn) & ~bits & (kColumn << (kPacked - 1));
+                    return std::countr_zero(zero) / kPacked;
+                }
+                const auto *rows = this->order.data() + set * this->ways;
+                std::size_t way  = 0;
+                while (rows[way] != 0)
+                    ++way;
+                return way;
+            }
+            case Policy::PLRU: {
+                const auto bits  = this->order[set];
+                std::size_t node = 1;
+                std::size_t way  = 0;
+                for (std::size_t half = this->ways / 2; half != 0; half /= 2) {
+                    const bool right = (bits >> node) & 1;
+                    way |= right ? half : 0;
+                    node = node * 2 + right;
+                }
+                return way;
             }
+            case Policy::FIFO: return this->order[set];
+            case Policy::Random: {
+                // xorshift64
+                this->seed ^= this->seed << 13;
+                this->seed ^= this->seed >> 7;
+                this->seed ^= this->seed << 17;
+                return this->seed % this->ways;
+            }
+            default: unreachable();
         }
-        return false;
     }
 };
 
-class Cache {
+/**
+ * The data cache, from L1D down to the memory.
+ *
+ * A load miss reads the line from the level below, and fills it in.
+ * A store miss does the same with write-allocate, or else is passed down.
+ * A store is also passed down at once with write-through, while with
+ * write-back, a dirty line is only written down when evicted.
+ */
+class Hierarchy {
 public:
-    explicit Cache() = default;
+    explicit Hierarchy(std::span<const Level> levels) : levels(levels.begin(), levels.end()) {}
 
-    bool load(Addr_t low, Addr_t high) {
-        Addr_t group_index = get_group_index(low);
-        return groups[group_index].load(low, high, counter);
-    }
+    void load(Addr_t addr) { this->load(0, addr); }
+    void store(Addr_t addr) { this->store(0, addr, false); }
 
-    bool store(Addr_t low, Addr_t high) {
-        Addr_t group_index = get_group_index(low);
-        return groups[group_index].store(low, high, counter);
-    }
+    auto get_levels() const -> std::span<const Storage> { return this->levels; }
+    // Lines read from the memory.
+    auto get_load() const -> std::size_t { return this->memory_load; }
+    // Lines (or words, with write-through) written to the memory.
+    auto get_store() const -> std::size_t { return this->memory_store; }
 
-    auto get_load() const -> std::size_t { return counter.count_load_real; }
+private:
+    std::vector<Storage> levels;
+    std::size_t memory_load  = 0;
+    std::size_t memory_store = 0;
 
-    auto get_store() const -> std::size_t { return counter.count_write_back; }
+    void load(std::size_t i, Addr_t addr) {
+        if (i == this->levels.size())
+            return void(++this->memory_load);
 
-private:
-    friend class CacheGroup;
+        auto &level = this->levels[i];
+        if (level.access(addr, false))
+            return void(++level.stats.load_hit);
+
+        ++level.stats.load_miss;
+        this->load(i + 1, addr);
+        this->fill(i, addr, false);
+    }
 
-    CacheGroup groups[CacheGroupSize]; // 组关联缓存中的各个组
-    CacheCounter counter;
+    /* A whole line written back from above needs not be read first. */
+    void store(std::size_t i, Addr_t addr, bool whole) {
+        if (i == this->levels.size())
+            return void(++this->memory_store);
+
+        auto &level     = this->levels[i];
+        const bool back = level.level.write_back;
+        if (level.access(addr, back)) {
+            ++level.stats.store_hit;
+        } else {
+            ++level.stats.store_miss;
+            if (!level.level.write_allocate)
+                return this->store(i + 1, addr, whole);
+            if (!whole)
+                this->load(i + 1, addr);
+            this->fill(i, addr, back);
+        }
+
+        if (!back)
+            this->store(i + 1, addr, whole);
+    }
 
-    static constexpr Addr_t get_group_index(Addr_t addr) {
-        return (addr / CacheLineSize) % CacheGroupSize;
+    void fill(std::size_t i, Addr_t addr, bool dirty) {
+        const auto evicted = this->levels[i].fill(addr, dirty);
+        if (!evicted.has_value())
+            return;
+        // Only a line no smaller than the one below covers it whole.
+        const bool whole = i + 1 == this->levels.size()
+                        || this->levels[i].level.line >= this->levels[i + 1].level.line;
+        this->store(i + 1, *evicted, whole);
     }
 };
 
-} // namespace kupi
+} // namespace dark::cache
@@ -6,32 +6,102 @@
 #include "interpreter/memory.h"
 #include "interpreter/register.h"
 #include "utility/error.h"
+#include "utility/misc.h"
 
 namespace dark {
 
-struct Executable::MetaData::PackData {
+// Each shape only loads the registers it uses.
+
+struct Executable::MetaData::RType {
     target_size_t &rd;
     target_size_t rs1;
     target_size_t rs2;
+};
+
+struct Executable::MetaData::IType {
+    target_size_t &rd;
+    target_size_t rs1;
+    target_size_t imm;
+};
+
+struct Executable::MetaData::SType {
+    target_size_t rs1;
+    target_size_t rs2;
+    target_size_t imm;
+};
+
+struct Executable::MetaData::UType {
+    target_size_t &rd;
     target_size_t imm;
 };
 
-inline auto Executable::MetaData::parse(RegisterFile &rf) const -> PackData {
-    auto &rd = rf[this->rd];
-    auto rs1 = rf[this->rs1];
-    auto rs2 = rf[this->rs2];
-    auto imm = this->imm;
-    return PackData{.rd = rd, .rs1 = rs1, .rs2 = rs2, .imm = imm};
+inline auto Executable::MetaData::parse_r(RegisterFile &rf) const -> RType {
+    return RType{.rd = rf[this->rd], .rs1 = rf[this->rs1], .rs2 = rf[this->rs2]};
+}
+
+inline auto Executable::MetaData::parse_i(RegisterFile &rf) const -> IType {
+    return IType{.rd = rf[this->rd], .rs1 = rf[this->rs1], .imm = this->imm};
+}
+
+inline auto Executable::MetaData::parse_s(RegisterFile &rf) const -> SType {
+    return SType{.rs1 = rf[this->rs1], .rs2 = rf[this->rs2], .imm = this->imm};
+}
+
+inline auto Executable::MetaData::parse_u(RegisterFile &rf) const -> UType {
+    return UType{.rd = rf[this->rd], .imm = this->imm};
 }
 
 } // namespace dark
 
+#if defined(REIMU_THREADED_DISPATCH)
+
+#if __has_cpp_attribute(clang::musttail)
+#define REIMU_MUSTTAIL [[clang::musttail]]
+#else
+// Rely on sibling call optimization. The chain is bounded, see backend.cpp.
+#define REIMU_MUSTTAIL
+#endif
+
+/**
+ * Jump to the command n bytes away directly, as long as the current dispatch
+ * still has some commands to chain. Otherwise, return it as a hint.
+ */
+#define return_next_by(exe, rf, mem, dev, n)                                                       \
+    do {                                                                                           \
+        auto &__next = *exe.next(n).next;                                                          \
+        if (rf.chain_next())                                                                       \
+            REIMU_MUSTTAIL return __next.get_func()(__next, rf, mem, dev);                         \
+        return Hint{&__next};                                                                      \
+    } while (false)
+
+// A fused pair of commands takes two from the chain.
+#define return_fused(exe, rf, mem, dev)                                                            \
+    do {                                                                                           \
+        rf.chain_skip();                                                                           \
+        return_next_by(exe, rf, mem, dev, 8);                                                      \
+    } while (false)
+
+#else
+
+#define return_next_by(exe, rf, mem, dev, n)                                                       \
+    do {                                                                                           \
+        allow_unused(rf, mem, dev);                                                                \
+        return exe.next(n);                                                                        \
+    } while (false)
+
+#define return_fused(exe, rf, mem, dev) return_next_by(exe, rf, mem, dev, 8)
+
+#endif
+
+#define return_next(exe, rf, mem, dev) return_next_by(exe, rf, mem, dev, 4)
+
 namespace dark::interpreter {
 
 namespace __details {
 
+/* The result of an arithmetic command. Only division may throw. */
 template <general::ArithOp op>
-static void arith_impl(target_size_t &rd, target_size_t rs1, target_size_t rs2, Device &dev) {
+static auto arith_eval(target_size_t rs1, target_size_t rs2) -> target_size_t {
     static_assert(sizeof(target_size_t) == 4);
 
     using i32 = std::int32_t;
@@ -47,79 +117,26 @@ static void arith_impl(target_size_t &rd, target_size_t rs1, target_size_t rs2,
     }
 
     switch (op) {
-        case ADD:
-            rd = rs1 + rs2;
-            dev.counter.wArith++;
-            return;
-        case SUB:
-            rd = rs1 - rs2;
-            dev.counter.wArith++;
-            return;
-        case AND:
-            rd = rs1 & rs2;
-            dev.counter.wBitwise++;
-            return;
-        case OR:
-            rd = rs1 | rs2;
-            dev.counter.wBitwise++;
-            return;
-        case XOR:
-            rd = rs1 ^ rs2;
-            dev.counter.wBitwise++;
-            return;
-        case SLL:
-            rd = rs1 << rs2;
-            dev.counter.wShift++;
-            return;
-        case SRL:
-            rd = u32(rs1) >> rs2;
-            dev.counter.wShift++;
-            return;
-        case SRA:
-            rd = i32(rs1) >> rs2;
-            dev.counter.wShift++;
-            return;
-        case SLT:
-            rd = i32(rs1) < i32(rs2);
-            dev.counter.wCompare++;
-            return;
-        case SLTU:
-            rd = u32(rs1) < u32(rs2);
-            dev.counter.wCompare++;
-            return;
-        case MUL:
-            rd = rs1 * rs2;
-            dev.counter.wMultiply++;
-            return;
-        case MULH:
-            rd = (i64(rs1) * i64(rs2)) >> 32;
-            dev.counter.wMultiply++;
-            return;
-        case MULHSU:
-            rd = (i64(rs1) * u64(rs2)) >> 32;
-            dev.counter.wMultiply++;
-            return;
-        case MULHU:
-            rd = (u64(rs1) * u64(rs2)) >> 32;
-            dev.counter.wMultiply++;
-            return;
-        case DIV:
-            rd = check_zero : i32(rs1) / i32(rs2);
-            dev.counter.wDivide++;
-            return;
-        case DIVU:
-            rd = check_zero : u32(rs1) / u32(rs2);
-            dev.counter.wDivide++;
-            return;
-        case REM:
-            rd = check_zero : i32(rs1) % i32(rs2);
-            dev.counter.wDivide++;
-            return;
-        case REMU:
-            rd = check_zero : u32(rs1) % u32(rs2);
-            dev.counter.wDivide++;
-            return;
-        default: unreachable();
+        case ADD:    return rs1 + rs2;
+        case SUB:    return rs1 - rs2;
+        case AND:    return rs1 & rs2;
+        case OR:     return rs1 | rs2;
+        case XOR:    return rs1 ^ rs2;
+        case SLL:    return rs1 << rs2;
+        case SRL:    return u32(rs1) >> rs2;
+        case SRA:    return i32(rs1) >> rs2;
+        case SLT:    return i32(rs1) < i32(rs2);
+        case SLTU:   return u32(rs1) < u32(rs2);
+        case MUL:    return rs1 * rs2;
+        case MULH:   return (i64(rs1) * i64(rs2)) >> 32;
+        case MULHSU: return (i64(rs1) * u64(rs2)) >> 32;
+        case MULHU:  return (u64(rs1) * u64(rs2)) >> 32;
+        // By -1, the most negative one overflows, which traps on the host.
+        case DIV:    return check_zero : rs2 == u32(-1) ? -rs1 : i32(rs1) / i32(rs2);
+        case DIVU:   return check_zero : u32(rs1) / u32(rs2);
+        case REM:    return check_zero : rs2 == u32(-1) ? 0 : i32(rs1) % i32(rs2);
+        case REMU:   return check_zero : u32(rs1) % u32(rs2);
+        default:     unreachable();
     }
 #undef check_zero
 }
@@ -128,81 +145,92 @@ static void arith_impl(target_size_t &rd, target_size_t rs1, target_size_t rs2,
 
 namespace ArithReg {
 template <general::ArithOp op>
-static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
-    auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
-    __details::arith_impl<op>(rd, rs1, rs2, dev);
-    return exe.next();
+static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
+    auto &&[rd, rs1, rs2] = exe.get_meta().parse_r(rf);
+    rd                    = __details::arith_eval<op>(rs1, rs2);
+    return_next(exe, rf, mem, dev);
 }
 } // namespace ArithReg
 
 namespace ArithImm {
 template <general::ArithOp op>
-static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
-    auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
-    __details::arith_impl<op>(rd, rs1, imm, dev);
-    return exe.next();
+static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
+    auto &&[rd, rs1, imm] = exe.get_meta().parse_i(rf);
+    rd                    = __details::arith_eval<op>(rs1, imm);
+    return_next(exe, rf, mem, dev);
+}
+
+/* rs1 == zero, e.g. li. The result is folded into the immediate when parsing. */
+template <general::ArithOp op>
+static auto li(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
+    auto &&[rd, imm] = exe.get_meta().parse_u(rf);
+    rd               = imm;
+    return_next(exe, rf, mem, dev);
+}
+
+/* imm == 0 with an identity operation, e.g. mv. */
+template <general::ArithOp op>
+static auto mv(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
+    auto &&[rd, rs1, _] = exe.get_meta().parse_i(rf);
+    rd                  = rs1;
+    return_next(exe, rf, mem, dev);
 }
 } // namespace ArithImm
 
-namespace LoadStore {
-template <general::MemoryOp op>
-static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) {
-    auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
-    auto addr                  = rs1 + imm;
+// rd == zero, e.g. nop. Nothing to do. Not for division, which may throw.
+namespace ArithNop {
+template <general::ArithOp op>
+static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
+    return_next(exe, rf, mem, dev);
+}
+} // namespace ArithNop
+
+/**
+ * Handlers below come in a few sets, one for each combination of the timing
+ * models, see Device::Model. The set is picked once when parsing, so that a
+ * model which is not enabled costs nothing at runtime.
+ */
 
+namespace LoadStore {
+template <general::MemoryOp op, bool kCache>
+static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     using enum general::MemoryOp;
-    switch (op) {
-        case LB:
-            rd = mem.load_i8(addr);
-            dev.counter.wLoad++;
-            dev.try_load(addr, 1);
-            break;
-        case LH:
-            rd = mem.load_i16(addr);
-            dev.counter.wLoad++;
-            dev.try_load(addr, 2);
-            break;
-        case LW:
-            rd = mem.load_i32(addr);
-            dev.counter.wLoad++;
-            dev.try_load(addr, 4);
-            break;
-        case LBU:
-            rd = mem.load_u8(addr);
-            dev.counter.wLoad++;
-            dev.try_load(addr, 1);
-            break;
-        case LHU:
-            rd = mem.load_u16(addr);
-            dev.counter.wLoad++;
-            dev.try_load(addr, 2);
-            break;
-        case SB:
-            mem.store_u8(addr, rs2);
-            dev.counter.wStore++;
-            dev.try_store(addr, 1);
-            break;
-        case SH:
-            mem.store_u16(addr, rs2);
-            dev.counter.wStore++;
-            dev.try_store(addr, 2);
-            break;
-        case SW:
-            mem.store_u32(addr, rs2);
-            dev.counter.wStore++;
-            dev.try_store(addr, 4);
-            break;
-        default: unreachable();
+    if constexpr (op == LB || op == LH || op == LW || op == LBU || op == LHU) {
+        auto &&[rd, rs1, imm] = exe.get_meta().parse_i(rf);
+        auto addr             = rs1 + imm;
+        target_size_t size{};
+        switch (op) {
+            case LB:  rd = mem.load_i8(addr), size = 1; break;
+            case LH:  rd = mem.load_i16(addr), size = 2; break;
+            case LW:  rd = mem.load_i32(addr), size = 4; break;
+            case LBU: rd = mem.load_u8(addr), size = 1; break;
+            case LHU: rd = mem.load_u16(addr), size = 2; break;
+            default:  unreachable();
+        }
+        if constexpr (kCache)
+            dev.try_load(addr, size);
+    } else {
+        auto &&[rs1, rs2, imm] = exe.get_meta().parse_s(rf);
+        auto addr              = rs1 + imm;
+        target_size_t size{};
+        switch (op) {
+            case SB: mem.store_u8(addr, rs2), size = 1; break;
+            case SH: mem.store_u16(addr, rs2), size = 2; break;
+            case SW: mem.store_u32(addr, rs2), size = 4; break;
+            default: unreachable();
+        }
+        if constexpr (kCache)
+            dev.try_store(addr, size);
     }
 
-    return exe.next();
+    return_next(exe, rf, mem, dev);
 }
 } // namespace LoadStore
 
 namespace Branch {
-template <general::BranchOp op>
+template <general::BranchOp op, bool kPredict>
 static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
-    auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
+    auto &&[rs1, rs2, imm] = exe.get_meta().parse_s(rf); // B shares the operands of S
     static_assert(sizeof(target_size_t) == 4);
 
     using i32 = std::int32_t;
@@ -212,34 +240,20 @@ static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
 
     bool result{};
     switch (op) {
-        case BEQ:
-            result = (rs1 == rs2);
-            dev.counter.wBranch++;
-            break;
-        case BNE:
-            result = (rs1 != rs2);
-            dev.counter.wBranch++;
-            break;
-        case BLT:
-            result = (i32(rs1) < i32(rs2));
-            dev.counter.wBranch++;
-            break;
-        case BGE:
-            result = (i32(rs1) >= i32(rs2));
-            dev.counter.wBranch++;
-            break;
-        case BLTU:
-            result = (u32(rs1) < u32(rs2));
-            dev.counter.wBranch++;
-            break;
-        case BGEU:
-            result = (u32(rs1) >= u32(rs2));
-            dev.counter.wBranch++;
-            break;
-        default: unreachable();
+        case BEQ:  result = (rs1 == rs2); break;
+        case BNE:  result = (rs1 != rs2); break;
+        case BLT:  result = (i32(rs1) < i32(rs2)); break;
+        case BGE:  result = (i32(rs1) >= i32(rs2)); break;
+        case BLTU: result = (u32(rs1) < u32(rs2)); break;
+        case BGEU: result = (u32(rs1) >= u32(rs2)); break;
+        default:   unreachable();
     }
 
-    dev.predict(rf.get_pc(), result);
+    if constexpr (kPredict)
+        dev.predict(rf.get_pc(), result);
+    else
+        allow_unused(dev);
+
     if (result) {
         rf.set_pc(rf.get_pc() + imm);
         return exe.next(imm);
@@ -249,53 +263,141 @@ static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
 }
 } // namespace Branch
 
+/* A call links to ra. A return is a jalr which links nothing, back to ra. */
+static auto get_jump(const Executable::MetaData &meta, bool indirect) -> predictor::Jump {
+    if (meta.rd == Register::ra)
+        return predictor::Jump::Call;
+    if (indirect && meta.rd == Register::zero && meta.rs1 == Register::ra)
+        return predictor::Jump::Return;
+    return predictor::Jump::Other;
+}
+
 namespace Jump {
-[[maybe_unused]]
+template <bool kPredict>
 static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
-    auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
+    const auto &meta = exe.get_meta();
+    auto &&[rd, imm] = meta.parse_u(rf); // J shares the operands of U
+
+    if constexpr (kPredict)
+        dev.jump(rf.get_pc(), rf.get_pc() + imm, get_jump(meta, false));
+    else
+        allow_unused(dev);
 
     rd = rf.get_pc() + 4;
     rf.set_pc(rf.get_pc() + imm);
-    dev.counter.wJal++;
 
     return exe.next(imm);
 }
 } // namespace Jump
 
 namespace Jalr {
-[[maybe_unused]]
+template <bool kPredict>
 static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
-    auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
+    const auto &meta      = exe.get_meta();
+    auto &&[rd, rs1, imm] = meta.parse_i(rf);
 
     auto target = (rs1 + imm) & ~1;
     auto offset = target - rf.get_pc();
 
+    if constexpr (kPredict)
+        dev.jump(rf.get_pc(), target, get_jump(meta, true));
+    else
+        allow_unused(dev);
+
     rd = rf.get_pc() + 4;
     rf.set_pc(target);
-    dev.counter.wJalr++;
 
     return exe.next(offset);
 }
 } // namespace Jalr
 
+// Also used by auipc, whose pc is folded into the immediate when parsing.
 namespace Lui {
 [[maybe_unused]]
-static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
-    auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
-    rd                         = imm;
-    dev.counter.wUpper++;
-    return exe.next();
+static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
+    auto &&[rd, imm] = exe.get_meta().parse_u(rf);
+    rd               = imm;
+    return_next(exe, rf, mem, dev);
 }
 } // namespace Lui
 
-namespace Auipc {
+/**
+ * Fused pairs, see compile_block in interpreter/executable.cpp.
+ * Each one behaves just as if both commands are executed one by one.
+ */
+namespace Fused {
+
+/* lui + addi, or auipc + addi. The result is folded into the immediate. */
 [[maybe_unused]]
-static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
-    auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
-    rd                         = rf.get_pc() + imm;
-    dev.counter.wUpper++;
-    return exe.next();
+static auto li(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
+    auto &&[rd, imm] = exe.get_meta().parse_u(rf);
+    rd               = imm;
+    return_fused(exe, rf, mem, dev);
 }
-} // namespace Auipc
+
+/* slli rd, rs1, imm + add rd, rd, rs2. rs2 is never rd. */
+[[maybe_unused]]
+static auto shadd(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
+    const auto &meta      = exe.get_meta();
+    auto &&[rd, rs1, rs2] = meta.parse_r(rf);
+    rd                    = (rs1 << meta.imm) + rs2;
+    return_fused(exe, rf, mem, dev);
+}
+
+/**
+ * slt(u) rd, rs1, rs2 + beqz/bnez rd, imm.
+ * As the last one of a block, the pc is the one of the compare.
+ */
+template <general::ArithOp cmp, general::BranchOp op, bool kPredict>
+static auto branch(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
+    const auto &meta      = exe.get_meta();
+    auto &&[rd, rs1, rs2] = meta.parse_r(rf);
+
+    rd                = __details::arith_eval<cmp>(rs1, rs2);
+    const bool result = (op == general::BranchOp::BNE) == (rd != 0);
+
+    const auto pc = rf.get_pc() + sizeof(command_size_t);
+    if constexpr (kPredict)
+        dev.predict(pc, result);
+    else
+        allow_unused(dev);
+
+    if (result) {
+        rf.set_pc(pc + meta.imm);
+        return exe.next(meta.imm + sizeof(command_size_t));
+    } else {
+        rf.set_pc(pc + sizeof(command_size_t));
+        return exe.next(2 * sizeof(command_size_t));
+    }
+}
+
+/**
+ * auipc rs1, hi + jalr rd, lo(rs1). The immediate is hi + lo.
+ * As the last one of a block, the pc is the one of the auipc.
+ */
+template <bool kPredict>
+static auto call(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
+    const auto &meta = exe.get_meta();
+    const auto pc    = rf.get_pc();
+    // Low 12 bits of hi are always zero, so lo can be recovered from the sum.
+    const auto lo = static_cast<target_size_t>(static_cast<std::int32_t>(meta.imm << 20) >> 20);
+
+    rf[meta.rs1] = pc + (meta.imm - lo);
+    auto target  = (pc + meta.imm) & ~1;
+    if constexpr (kPredict)
+        dev.jump(pc + sizeof(command_size_t), target, get_jump(meta, false));
+    else
+        allow_unused(dev);
+    rf[meta.rd]  = pc + 2 * sizeof(command_size_t);
+    rf.set_pc(target);
+
+    return exe.next(target - pc);
+}
+
+} // namespace Fused
 
 } // namespace dark::interpreter
+
+#undef return_fused
+#undef return_next
+#undef return_next_by
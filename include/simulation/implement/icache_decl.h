@@ -1,16 +1,62 @@
+// Should only be included in interpretor/backend.cpp
+#include "config/counter.h"
 #include "interpreter/executable.h"
 #include "interpreter/memory.h"
+#include "simulation/pipeline.h"
+#include <deque>
 #include <memory>
+#include <utility>
+#include <vector>
 
 namespace dark {
 
 struct ICache {
+    /* A straight-line run of commands, which can only be left at the last one. */
+    struct Block {
+        Executable *entry;
+        std::size_t count;
+    };
+
     explicit ICache(Memory &);
     auto ifetch(target_size_t, Hint) noexcept -> Executable &;
+    auto bfetch(target_size_t, Hint, Memory &, Device &) -> Block;
+    void cut(Executable &, Memory &, Device &);
+    void predecode(Memory &, Device &);
+
+    void record(Executable *, std::size_t, Memory &, Device &);
+    void issue(target_size_t, std::size_t);
+    void commit(Device &);
 
 private:
+    using Member_t = std::size_t weight::Counter::*;
+
+    struct Trace;
+
+    /* A block run right after another one. */
+    struct Link {
+        Executable *entry;
+        Trace *trace;
+    };
+
+    /* A translated block, with its static profile and its known successors. */
+    struct Trace {
+        std::size_t which;
+        target_size_t length;
+        std::size_t hits; // Whole runs not yet counted
+        std::vector<std::pair<Member_t, target_size_t>> histogram;
+        Link links[2];              // Most recent first
+        pipeline::Summary pipeline; // Only with --pipeline
+    };
+
+    auto build_block(std::size_t, Memory &, Device &) -> Trace *;
+    void count_run(std::size_t, std::size_t, Memory &, Device &);
+
     const std::size_t length; // Command length
     std::unique_ptr<Executable[]> cached;
+    std::unique_ptr<Trace *[]> traces; // Null if not built yet
+    std::deque<Trace> storage;         // Of all the blocks built
+    Trace *last = nullptr;             // The block fetched last time, if any
+    pipeline::Tracker tracker;         // Only with --pipeline
 };
 
 } // namespace dark
@@ -1,13 +1,23 @@
 #include "declarations.h"
+#include "interpreter/device.h"
 #include "interpreter/interval.h"
 #include "libc/libc.h"
 #include "simulation/implement/icache_decl.h"
 #include "utility/error.h"
+#include <algorithm>
+#include <span>
+#include <thread>
+#include <vector>
 
 namespace dark {
 
-// This function is implemented in interpreter/executable.cpp
+// These functions are implemented in interpreter/executable.cpp
 Function_t compile_once;
+auto compile_block(std::span<Executable>, target_size_t, Memory &, Device &) -> std::size_t;
+void unfuse_once(Executable &, target_size_t, Memory &, Device::Model);
+auto predecode(std::span<Executable>, target_size_t, Memory &, Device::Model) -> std::size_t;
+auto counter_of(command_size_t) -> std::size_t weight::Counter::*;
+auto operands_of(command_size_t) -> Executable::MetaData;
 
 static auto make_icache_range(Memory &mem) -> target_size_t {
     const auto text = mem.get_text_range();
@@ -41,6 +51,7 @@ inline ICache::ICache(Memory &mem) : length(make_icache_range(mem)) {
 
     // Initialize the cache
     this->cached = std::make_unique<Executable[]>(reserved);
+    this->traces = std::make_unique<Trace *[]>(reserved);
 
     // libc functions
     for (std::size_t i = 0; i < libcsize; ++i)
@@ -63,4 +74,199 @@ inline auto ICache::ifetch(target_size_t pc, Hint hint) noexcept -> Executable &
     return this->cached[which];
 }
 
+/**
+ * Fetch the block starting at given pc.
+ * The block is translated as a whole on its first fetch.
+ *
+ * Each block remembers the last two blocks run after it, e.g. both ways of
+ * a branch, or the target of a return. If the hint matches one of them,
+ * it is followed directly, without any range check or lookup.
+ */
+inline auto ICache::bfetch(target_size_t pc, Hint hint, Memory &mem, Device &dev) -> Block {
+    auto *prev = std::exchange(this->last, nullptr);
+    if (prev != nullptr && hint.next != nullptr) [[likely]] {
+        for (const auto &link : prev->links) {
+            if (link.entry == hint.next) {
+                this->last = link.trace;
+                return {link.entry, link.trace->length};
+            }
+        }
+    }
+
+    auto &exe        = this->ifetch(pc, hint);
+    const auto which = static_cast<std::size_t>(&exe - this->cached.get());
+
+    // Cache miss, which will be reported when executed.
+    if (which >= this->length) [[unlikely]]
+        return {&exe, 1};
+
+    auto &trace = this->traces[which];
+    if (trace == nullptr) [[unlikely]]
+        trace = this->build_block(which, mem, dev);
+
+    if (prev != nullptr) {
+        prev->links[1] = prev->links[0];
+        prev->links[0] = {.entry = &exe, .trace = trace};
+    }
+
+    this->last = trace;
+    return {&exe, trace->length};
+}
+
+/**
+ * Make sure the given command only executes itself,
+ * so that a block can be cut short right after it.
+ */
+inline void ICache::cut(Executable &exe, Memory &mem, Device &dev) {
+    if (exe.get_meta().fusion == Executable::MetaData::Fusion::None)
+        return;
+    const auto which = static_cast<std::size_t>(&exe - this->cached.get());
+    unfuse_once(exe, kTextStart + which * sizeof(command_size_t), mem, dev.get_model());
+}
+
+/**
+ * Decode the whole text section eagerly, with several threads working
+ * on disjoint ranges. Only the parsing is done here, blocks are still
+ * built on their first fetch, which is now much cheaper.
+ */
+inline void ICache::predecode(Memory &mem, Device &dev) {
+    // Too small a range is not worth a thread.
+    constexpr std::size_t kMinRange = 1 << 14;
+
+    const auto libcsize = std::size(libc::funcs);
+    const auto total    = this->length - libcsize;
+    const auto hardware = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    const auto model    = dev.get_model();
+    const auto workers  = std::clamp<std::size_t>(total / kMinRange, 1, hardware);
+
+    std::vector<std::size_t> parsed(workers);
+    {
+        std::vector<std::jthread> threads;
+        for (std::size_t i = 0; i < workers; ++i) {
+            const auto first = libcsize + total * i / workers;
+            const auto last  = libcsize + total * (i + 1) / workers;
+            const auto text  = std::span{this->cached.get() + first, this->cached.get() + last};
+            const auto pc    = kTextStart + first * sizeof(command_size_t);
+            threads.emplace_back([&result = parsed[i], text, pc, &mem, model] {
+                result = dark::predecode(text, pc, mem, model);
+            });
+        }
+    } // Join all the threads here.
+
+    for (auto count : parsed)
+        dev.counter.iparse += count;
+}
+
+/**
+ * Record a run of count commands from the given one. The handlers do not
+ * count anything on their own. A run of the whole block only bumps its
+ * hit count, which is multiplied out by its histogram when committed.
+ * Any other run, e.g. a single step of the debugger, is counted at once.
+ */
+inline void ICache::record(Executable *entry, std::size_t count, Memory &mem, Device &dev) {
+    // Almost always the block just fetched, run as a whole.
+    auto *trace = this->last;
+    if (trace != nullptr && trace->length == count) [[likely]] {
+        trace->hits += 1;
+        return;
+    }
+
+    const auto which = static_cast<std::size_t>(entry - this->cached.get());
+    // Cache miss, which never runs to the end.
+    if (which >= this->length) [[unlikely]]
+        return;
+
+    this->count_run(which, count, mem, dev);
+}
+
+/**
+ * Enter the block just recorded in the pipeline model, if it is run as
+ * a whole. The stalls inside are counted with the block, so only those
+ * on the results of the blocks before, and the flush of a taken jump,
+ * are tracked here, and added to the counters when committed.
+ */
+inline void ICache::issue(target_size_t pc, std::size_t count) {
+    if (auto *trace = this->last; trace != nullptr && trace->length == count) [[likely]]
+        this->tracker.enter(pc, trace->pipeline);
+}
+
+/* Add all the runs recorded so far to the counters. */
+inline void ICache::commit(Device &dev) {
+    dev.counter.wStall += std::exchange(this->tracker.stalls, 0);
+    dev.counter.wFlush += std::exchange(this->tracker.flushes, 0);
+
+    for (auto &trace : this->storage) {
+        const auto times = std::exchange(trace.hits, 0);
+        // Libc functions have their own counters.
+        if (times == 0 || trace.histogram.empty())
+            continue;
+
+        weight::Counter counter{};
+        for (const auto &[member, count] : trace.histogram)
+            counter.*member = count * times;
+
+        const auto pc =
+            static_cast<target_size_t>(kTextStart + trace.which * sizeof(command_size_t));
+        dev.add_block({.pc = pc, .length = trace.length, .times = times}, counter);
+    }
+}
+
+inline void ICache::count_run(std::size_t which, std::size_t count, Memory &mem, Device &dev) {
+    // Libc functions have their own counters.
+    const auto first = std::max(which, std::size(libc::funcs));
+    for (std::size_t i = first; i < which + count; ++i) {
+        const auto cmd = mem.load_cmd(kTextStart + i * sizeof(command_size_t));
+        dev.counter.*counter_of(cmd) += 1;
+    }
+}
+
+inline auto ICache::build_block(std::size_t which, Memory &mem, Device &dev) -> Trace * {
+    auto &trace = this->storage.emplace_back(Trace{
+        .which     = which,
+        .length    = 1,
+        .hits      = 0,
+        .histogram = {},
+        .links     = {},
+        .pipeline  = {},
+    });
+
+    // Each libc function is a block of its own.
+    if (which < std::size(libc::funcs))
+        return &trace;
+
+    const auto pc    = kTextStart + which * sizeof(command_size_t);
+    const auto text  = std::span{this->cached.get() + which, this->cached.get() + this->length};
+    const auto count = compile_block(text, pc, mem, dev);
+
+    // Count the classes of commands once, at translation.
+    auto &histogram = trace.histogram;
+    std::vector<pipeline::Command> commands;
+    const bool timing = dev.get_model().pipeline;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (text[i].get_func() == compile_once)
+            break; // Unknown command, which fails when executed.
+        const auto cmd    = mem.load_cmd(pc + i * sizeof(command_size_t));
+        const auto member = counter_of(cmd);
+        auto iter         = std::ranges::find_if(histogram, [&](const auto &pair) {
+            return pair.first == member;
+        });
+        if (iter == histogram.end())
+            histogram.emplace_back(member, 1);
+        else
+            iter->second += 1;
+        if (timing)
+            commands.push_back({.member = member, .meta = operands_of(cmd)});
+    }
+
+    // So are the stalls inside, with the pipeline model.
+    if (timing) {
+        trace.pipeline = pipeline::summarize(pc, commands);
+        if (trace.pipeline.stalls != 0)
+            histogram.emplace_back(&weight::Counter::wStall, trace.pipeline.stalls);
+    }
+
+    trace.length = static_cast<target_size_t>(count);
+    return &trace;
+}
+
 } // namespace dark
@@ -1,14 +1,31 @@
+#include "config/predictor.h"
 #include "declarations.h"
 #include <array>
+#include <cstdint>
 #include <limits>
+#include <memory>
 
 namespace dark {
 
+/**
+ * The direction predictor of conditional branches.
+ * Each branch is first predicted, then updated with the real direction.
+ */
+struct BranchPredictor {
+public:
+    static auto create(predictor::Kind) -> std::unique_ptr<BranchPredictor>;
+    virtual ~BranchPredictor() = default;
+    virtual bool predict(target_size_t) = 0;
+    virtual void update(target_size_t, bool) = 0;
+};
+
+namespace predictor {
+
 /**
  * A simple 2 bit branch predictor.
  */
 // template <std::size_t _Nm = 4096>
-struct BranchPredictor {
+struct Bimodal final : BranchPredictor {
 private:
     using _Data_t = std::uint8_t;
 
@@ -29,9 +46,131 @@ private:
     auto set_bits(target_size_t, target_size_t) -> void;
 
 public:
-    BranchPredictor();
-    bool predict(target_size_t) const;
-    void update(target_size_t, bool);
+    Bimodal();
+    bool predict(target_size_t) override;
+    void update(target_size_t, bool) override;
+};
+
+/* A table of 2 bit saturating counters, one byte each. */
+template <std::size_t _Nm>
+struct Counters {
+public:
+    static_assert((_Nm & (_Nm - 1)) == 0, "Size must be a power of 2");
+    auto get(std::size_t index) const -> bool { return this->table[index & (_Nm - 1)] >= 2; }
+    void update(std::size_t index, bool taken);
+
+private:
+    std::array<std::uint8_t, _Nm> table = make_table();
+    // Weakly taken, the same as the bimodal predictor.
+    static constexpr auto make_table() {
+        std::array<std::uint8_t, _Nm> table;
+        table.fill(2);
+        return table;
+    }
+};
+
+/**
+ * Counters indexed by the pc xor the global history,
+ * so that a branch can be predicted by how the last ones went.
+ */
+struct Gshare final : BranchPredictor {
+public:
+    bool predict(target_size_t) override;
+    void update(target_size_t, bool) override;
+
+private:
+    static constexpr std::size_t kHistory = 12;
+    Counters<1 << kHistory> table;
+    std::size_t history = 0;
+
+    auto get_index(target_size_t) const -> std::size_t;
+};
+
+/**
+ * Both a bimodal and a gshare predictor, with a table of counters
+ * indexed by pc to choose between them, trained when they disagree.
+ */
+struct Tournament final : BranchPredictor {
+public:
+    bool predict(target_size_t) override;
+    void update(target_size_t, bool) override;
+
+private:
+    Bimodal local;
+    Gshare global;
+    Counters<4096> chooser; // Taken means to use the global one
+    bool local_guess  = false;
+    bool global_guess = false;
+};
+
+/**
+ * A small TAGE predictor: a bimodal base, and a few tagged tables indexed
+ * by the pc and longer and longer history. The table with the longest
+ * matching history provides the prediction. A misprediction allocates an
+ * entry in a table of longer history, which is how hard branches end up
+ * predicted with just enough history.
+ */
+struct Tage final : BranchPredictor {
+public:
+    bool predict(target_size_t) override;
+    void update(target_size_t, bool) override;
+
+private:
+    static constexpr std::size_t kTables  = 4;
+    static constexpr std::size_t kBits    = 10; // log2 of entries of each table
+    static constexpr std::size_t kTagBits = 8;
+    // Geometric, within the 64 bits of history kept.
+    static constexpr std::size_t kLength[kTables] = {4, 10, 24, 60};
+    // The useful bits are aged once after so many updates.
+    static constexpr std::size_t kAgePeriod = 1 << 18;
+
+    struct Entry {
+        bool valid; // Never allocated otherwise, so it matches no tag
+        std::uint8_t tag;
+        std::uint8_t counter; // 3 bits, taken iff >= 4
+        std::uint8_t useful;  // 2 bits
+    };
+
+    Bimodal base;
+    std::array<std::array<Entry, 1 << kBits>, kTables> tables{};
+    std::uint64_t history = 0;
+    std::size_t updates   = 0;
+
+    // Computed by predict, and used by the update of the same branch.
+    std::array<std::size_t, kTables> index{};
+    std::array<std::uint8_t, kTables> tag{};
+    std::size_t provider = kTables; // kTables if only the base matches
+    bool provider_guess  = false;
+    bool alternate_guess = false;
+
+    static auto fold(std::uint64_t history, std::size_t length, std::size_t bits) -> std::size_t;
+};
+
+} // namespace predictor
+
+/**
+ * The targets of jal and jalr, i.e. where the fetch goes next.
+ * A return is predicted by a return address stack, pushed by each call,
+ * and any other jump by a direct-mapped branch target buffer.
+ */
+struct TargetPredictor {
+public:
+    bool predict(target_size_t pc, target_size_t target, predictor::Jump kind);
+
+private:
+    static constexpr std::size_t kEntries = 512;
+    static constexpr std::size_t kDepth   = 16;
+
+    struct Entry {
+        target_size_t pc;
+        target_size_t target;
+    };
+
+    std::array<Entry, kEntries> buffer{};
+    std::array<target_size_t, kDepth> stack{};
+    std::size_t top = 0; // Wraps around, so the oldest are overwritten
+
+    bool lookup(target_size_t pc, target_size_t target);
 };
 
 } // namespace dark
@@ -1,4 +1,5 @@
 #include "simulation/implement/predictor_decl.h"
+#include "utility/error.h"
 
 namespace dark {
 
@@ -7,20 +8,32 @@ static auto div_mod(target_size_t index) {
     return std::make_pair(index / _Div, index % _Div);
 }
 
-inline BranchPredictor::BranchPredictor() : table() {
+inline auto BranchPredictor::create(predictor::Kind kind) -> std::unique_ptr<BranchPredictor> {
+    switch (kind) {
+        case predictor::Kind::Bimodal:    return std::make_unique<predictor::Bimodal>();
+        case predictor::Kind::Gshare:     return std::make_unique<predictor::Gshare>();
+        case predictor::Kind::Tournament: return std::make_unique<predictor::Tournament>();
+        case predictor::Kind::Tage:       return std::make_unique<predictor::Tage>();
+        default:                          unreachable();
+    }
+}
+
+namespace predictor {
+
+inline Bimodal::Bimodal() : table() {
     for (auto &entry : this->table) {
         static_assert(sizeof(entry) == 1);
         entry = _Data_t(0b10101010);
     }
 }
 
-inline auto BranchPredictor::predict(target_size_t pc) const -> bool {
+inline auto Bimodal::predict(target_size_t pc) -> bool {
     auto index           = this->get_index(pc);
     constexpr auto kHalf = kMask >> 1;
     return this->get_bits(index) > kHalf;
 }
 
-inline auto BranchPredictor::update(target_size_t pc, bool taken) -> void {
+inline auto Bimodal::update(target_size_t pc, bool taken) -> void {
     const auto index = this->get_index(pc);
     const auto data  = this->get_bits(index);
 
@@ -36,19 +49,165 @@ inline auto BranchPredictor::update(target_size_t pc, bool taken) -> void {
     }
 }
 
-inline auto BranchPredictor::get_index(target_size_t pc) -> target_size_t {
+inline auto Bimodal::get_index(target_size_t pc) -> target_size_t {
     static_assert(sizeof(command_size_t) == 4);
     return ((pc / sizeof(command_size_t)) & (_Nm - 1)) * kBits;
 }
 
-inline auto BranchPredictor::get_bits(target_size_t index) const -> target_size_t {
+inline auto Bimodal::get_bits(target_size_t index) const -> target_size_t {
     const auto [which, offset] = div_mod<kDigit>(index);
     return (this->table[which] >> offset) & kMask;
 }
 
-inline auto BranchPredictor::set_bits(target_size_t index, target_size_t delta) -> void {
+inline auto Bimodal::set_bits(target_size_t index, target_size_t delta) -> void {
     const auto [which, offset] = div_mod<kDigit>(index);
     this->table[which] ^= (delta << offset);
 }
 
+template <std::size_t _Nm>
+inline void Counters<_Nm>::update(std::size_t index, bool taken) {
+    auto &counter = this->table[index & (_Nm - 1)];
+    if (taken && counter != 3)
+        counter += 1;
+    if (!taken && counter != 0)
+        counter -= 1;
+}
+
+inline auto Gshare::get_index(target_size_t pc) const -> std::size_t {
+    return (pc / sizeof(command_size_t)) ^ this->history;
+}
+
+inline auto Gshare::predict(target_size_t pc) -> bool {
+    return this->table.get(this->get_index(pc));
+}
+
+inline void Gshare::update(target_size_t pc, bool taken) {
+    this->table.update(this->get_index(pc), taken);
+    this->history = ((this->history << 1) | taken) & ((1 << kHistory) - 1);
+}
+
+inline auto Tournament::predict(target_size_t pc) -> bool {
+    this->local_guess  = this->local.predict(pc);
+    this->global_guess = this->global.predict(pc);
+    const auto which   = pc / sizeof(command_size_t);
+    return this->chooser.get(which) ? this->global_guess : this->local_guess;
+}
+
+inline void Tournament::update(target_size_t pc, bool taken) {
+    if (this->local_guess != this->global_guess)
+        this->chooser.update(pc / sizeof(command_size_t), this->global_guess == taken);
+    this->local.update(pc, taken);
+    this->global.update(pc, taken);
+}
+
+/* Fold the latest length bits of history into the given bits, by xor. */
+inline auto Tage::fold(std::uint64_t history, std::size_t length, std::size_t bits)
+    -> std::size_t {
+    history &= ~std::uint64_t(0) >> (64 - length);
+    std::size_t result = 0;
+    for (; history != 0; history >>= bits)
+        result ^= history & ((std::size_t(1) << bits) - 1);
+    return result;
+}
+
+inline auto Tage::predict(target_size_t pc) -> bool {
+    const auto which = pc / sizeof(command_size_t);
+    for (std::size_t i = 0; i < kTables; ++i) {
+        const auto length = kLength[i];
+        const auto hash   = which ^ (which >> (kBits - i));
+        const auto tag    = which ^ fold(this->history, length, kTagBits)
+                       ^ (fold(this->history, length, kTagBits - 1) << 1);
+        this->index[i] = (hash ^ fold(this->history, length, kBits)) & ((1 << kBits) - 1);
+        this->tag[i]   = tag & ((1 << kTagBits) - 1);
+    }
+
+    // The longest match provides, and the next longest is the alternate.
+    this->provider        = kTables;
+    this->alternate_guess = this->base.predict(pc);
+    this->provider_guess  = this->alternate_guess;
+    for (std::size_t i = kTables; i-- > 0;) {
+        const auto &entry = this->tables[i][this->index[i]];
+        if (!entry.valid || entry.tag != this->tag[i])
+            continue;
+        if (this->provider == kTables) {
+            this->provider       = i;
+            this->provider_guess = entry.counter >= 4;
+        } else {
+            this->alternate_guess = entry.counter >= 4;
+            break;
+        }
+    }
+    return this->provider_guess;
+}
+
+inline void Tage::update(target_size_t pc, bool taken) {
+    const bool wrong = this->provider_guess != taken;
+
+    if (this->provider == kTables) {
+        this->base.update(pc, taken);
+    } else {
+        auto &entry = this->tables[this->provider][this->index[this->provider]];
+        if (taken && entry.counter != 7)
+            entry.counter += 1;
+        if (!taken && entry.counter != 0)
+            entry.counter -= 1;
+        // Useful only if it does better than what would be used without it.
+        if (this->provider_guess != this->alternate_guess) {
+            if (!wrong && entry.useful != 3)
+                entry.useful += 1;
+            if (wrong && entry.useful != 0)
+                entry.useful -= 1;
+        }
+    }
+
+    // Allocate one entry of longer history, or make room for the next time.
+    if (wrong) {
+        const auto first = this->provider == kTables ? 0 : this->provider + 1;
+        bool allocated   = false;
+        for (std::size_t i = first; i < kTables && !allocated; ++i) {
+            auto &entry = this->tables[i][this->index[i]];
+            if (entry.useful == 0) {
+                // Weakly towards the real direction.
+                entry.valid   = true;
+                entry.tag     = this->tag[i];
+                entry.counter = taken ? 4 : 3;
+                allocated     = true;
+            }
+        }
+        for (std::size_t i = first; i < kTables && !allocated; ++i) {
+            auto &entry = this->tables[i][this->index[i]];
+            entry.useful -= 1;
+        }
+    }
+
+    if (++this->updates % kAgePeriod == 0)
+        for (auto &table : this->tables)
+            for (auto &entry : table)
+                entry.useful >>= 1;
+
+    this->history = (this->history << 1) | taken;
+}
+
+} // namespace predictor
+
+inline bool TargetPredictor::lookup(target_size_t pc, target_size_t target) {
+    auto &entry     = this->buffer[(pc / sizeof(command_size_t)) % kEntries];
+    const bool good = entry.pc == pc && entry.target == target;
+    entry           = {.pc = pc, .target = target};
+    return good;
+}
+
+inline bool
+TargetPredictor::predict(target_size_t pc, target_size_t target, predictor::Jump kind) {
+    using enum predictor::Jump;
+    switch (kind) {
+        case Other: return this->lookup(pc, target);
+        case Call:
+            this->stack[this->top++ % kDepth] = pc + sizeof(command_size_t);
+            return this->lookup(pc, target);
+        case Return: return this->stack[--this->top % kDepth] == target;
+        default:           unreachable();
+    }
+}
+
 } // namespace dark
@@ -0,0 +1,31 @@
+#pragma once
+// Should only be included in interpreter/backend.cpp and interpreter/jit.cpp
+#include "declarations.h"
+#include "interpreter/forward.h"
+#include <cstddef>
+#include <memory>
+
+namespace dark {
+
+/**
+ * An optional native tier on top of the block interpreter.
+ *
+ * Blocks are counted on each execution. Once a block is hot, the longest
+ * straight-line prefix that the tier understands is translated into x86-64
+ * code. The rest of the block, including the branch/jal/jalr at the end,
+ * is always left to the interpreter.
+ */
+struct JitTier {
+public:
+    explicit JitTier(Memory &);
+    ~JitTier();
+
+    /* Run the block at current pc natively, return the number of commands done. */
+    auto run(RegisterFile &, Memory &, Device &, std::size_t count) -> std::size_t;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // namespace dark
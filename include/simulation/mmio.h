@@ -0,0 +1,92 @@
+#pragma once
+// Should only be included in interpreter/backend.cpp
+#include "declarations.h"
+#include "interpreter/device.h"
+#include "interpreter/exception.h"
+#include "interpreter/memory.h"
+#include <istream>
+#include <ostream>
+
+namespace dark::mmio {
+
+/**
+ * Devices mapped below the text section, where there is never any normal
+ * memory. An access is only checked against them after it falls out of all
+ * the normal areas, so normal memory accesses pay nothing for them.
+ */
+static constexpr target_size_t kUartBase = 0x1000;
+static constexpr target_size_t kDmaBase  = 0x1010;
+
+// Each byte costs the same as in libc I/O, without the call overhead.
+static constexpr std::size_t kByteWeight = 8;
+
+/**
+ * A byte-wide serial port. A store writes the low byte out,
+ * and a load reads one byte in, or -1 at the end of input.
+ */
+struct Uart final : Memory::Mapped {
+    explicit Uart(Device &dev) : dev(dev) {}
+
+    auto load(target_size_t, target_size_t) -> target_size_t override {
+        this->dev.counter.libcIO += kByteWeight;
+        return static_cast<target_size_t>(this->dev.in.get());
+    }
+
+    void store(target_size_t, target_size_t, target_size_t value) override {
+        this->dev.counter.libcIO += kByteWeight;
+        this->dev.out.put(static_cast<char>(value));
+    }
+
+private:
+    Device &dev;
+};
+
+/**
+ * Bulk output, without any formatting. It has two word registers:
+ * - +0: address. Storing to it writes the buffer there out as a whole.
+ * - +4: length of the buffer, in bytes.
+ * So a program stores the length first, then the address.
+ */
+struct DmaOutput final : Memory::Mapped {
+    explicit DmaOutput(Memory &mem, Device &dev) : mem(mem), dev(dev) {}
+
+    auto load(target_size_t offset, target_size_t) -> target_size_t override {
+        return offset < 4 ? this->address : this->length;
+    }
+
+    void store(target_size_t offset, target_size_t, target_size_t value) override {
+        if (offset >= 4)
+            return void(this->length = value);
+
+        this->address   = value;
+        const auto *raw = this->mem.read_range(this->address, this->length);
+        if (raw == nullptr)
+            throw FailToInterpret{
+                .error  = Error::LoadOutOfBound,
+                .detail = {.address = this->address, .size = this->length},
+            };
+
+        this->dev.out.write(raw, this->length);
+        this->dev.counter.libcIO += kByteWeight * this->length;
+    }
+
+private:
+    Memory &mem;
+    Device &dev;
+    target_size_t address = 0;
+    target_size_t length  = 0;
+};
+
+/* All the devices, mapped into the memory once created. */
+struct Devices {
+    explicit Devices(Memory &mem, Device &dev) : uart(dev), dma(mem, dev) {
+        mem.map_device(kUartBase, 1, this->uart);
+        mem.map_device(kDmaBase, 8, this->dma);
+    }
+
+private:
+    Uart uart;
+    DmaOutput dma;
+};
+
+} // namespace dark::mmio
@@ -0,0 +1,167 @@
+#pragma once
+#include "config/counter.h"
+#include "declarations.h"
+#include "interpreter/executable.h"
+#include "riscv/register.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace dark::pipeline {
+
+using Member_t = std::size_t weight::Counter::*;
+
+/**
+ * Slots from the issue of a command until a command using its result can
+ * issue, in an in-order 5-stage pipeline with full forwarding. A load is
+ * only ready after MEM, and mul/div stay in EX for a few more cycles.
+ */
+static constexpr std::size_t kLoad     = 2;
+static constexpr std::size_t kMultiply = 3;
+static constexpr std::size_t kDivide   = 10;
+
+inline auto latency_of(Member_t member) -> std::size_t {
+    if (member == &weight::Counter::wLoad)
+        return kLoad;
+    if (member == &weight::Counter::wMultiply)
+        return kMultiply;
+    if (member == &weight::Counter::wDivide)
+        return kDivide;
+    return 1;
+}
+
+/* One command of a block, by its class and operands. */
+struct Command {
+    Member_t member;
+    Executable::MetaData meta;
+};
+
+/* A register still being computed, and the slots left until it is ready. */
+struct Pending {
+    std::uint8_t reg;
+    std::uint8_t left;
+};
+
+// At most so many results are carried from one block to the next.
+// Only mul/div can take that long, so more is hardly ever needed.
+static constexpr std::size_t kCarry = 4;
+
+/* Results carried across blocks, the ones ready last if there are too many. */
+struct Carried {
+    std::array<Pending, kCarry> list;
+    std::size_t count;
+
+    void push(Pending what) {
+        if (this->count < kCarry)
+            return void(this->list[this->count++] = what);
+        auto slot = std::ranges::min_element(this->list, {}, &Pending::left);
+        if (slot->left < what.left)
+            *slot = what;
+    }
+};
+
+/**
+ * The timing of a block on its own, computed once when it is translated.
+ * The stalls inside are fixed, while those across blocks depend on which
+ * block runs before, so the first reads and the last writes are kept.
+ */
+struct Summary {
+    static constexpr std::uint8_t kNever = 0xff;
+
+    target_size_t end;                 // The pc right after the block
+    target_size_t cycles;              // Slots taken, with the stalls inside
+    target_size_t stalls;              // Stalls inside
+    std::uint32_t written;             // Registers written, one bit each
+    std::array<std::uint8_t, 32> head; // Slot of the first read before any write
+    Carried tail;                      // Results not ready at the end
+};
+
+inline auto summarize(target_size_t pc, std::span<const Command> block) -> Summary {
+    Summary result{
+        .end     = static_cast<target_size_t>(pc + block.size() * sizeof(command_size_t)),
+        .cycles  = 0,
+        .stalls  = 0,
+        .written = 0,
+        .head    = {},
+        .tail    = {},
+    };
+    result.head.fill(Summary::kNever);
+
+    // The slot a command reading each register can issue at.
+    std::array<std::size_t, 32> ready{};
+    std::size_t slot = 0;
+    for (const auto &[member, meta] : block) {
+        const auto rs1 = reg_to_int(meta.rs1);
+        const auto rs2 = reg_to_int(meta.rs2);
+        const auto rd  = reg_to_int(meta.rd);
+
+        const auto issue = std::max({slot, ready[rs1], ready[rs2]});
+        for (const auto rs : {rs1, rs2}) {
+            auto &first = result.head[rs];
+            if (rs == 0 || first != Summary::kNever || (result.written >> rs & 1) != 0)
+                continue;
+            first = static_cast<std::uint8_t>(std::min<std::size_t>(issue, Summary::kNever - 1));
+        }
+        if (rd != 0) {
+            ready[rd] = issue + latency_of(member);
+            result.written |= std::uint32_t(1) << rd;
+        }
+        slot = issue + 1;
+    }
+
+    result.cycles = static_cast<target_size_t>(slot);
+    result.stalls = static_cast<target_size_t>(slot - block.size());
+    for (std::size_t rd = 1; rd < 32; ++rd)
+        if (ready[rd] > slot)
+            result.tail.push({std::uint8_t(rd), std::uint8_t(ready[rd] - slot)});
+    return result;
+}
+
+/**
+ * The results carried from the blocks run so far, i.e. the last writer of
+ * each register which is still not ready, and where the last block ends.
+ * Entering a block which does not start there means a taken jump.
+ */
+struct Tracker {
+public:
+    std::size_t stalls  = 0; // Across blocks only
+    std::size_t flushes = 0;
+
+    void enter(target_size_t pc, const Summary &block) {
+        this->flushes += this->next != 0 && this->next != pc;
+        this->next = block.end;
+
+        // Mostly, nothing is carried from the block before.
+        if (this->pending.count == 0) [[likely]] {
+            this->pending = block.tail;
+            return;
+        }
+
+        std::size_t stalls = 0;
+        for (std::size_t i = 0; i < this->pending.count; ++i) {
+            const auto [reg, left] = this->pending.list[i];
+            if (left > block.head[reg])
+                stalls = std::max<std::size_t>(stalls, left - block.head[reg]);
+        }
+
+        // Age the old results, unless written again, and add the new ones.
+        const auto elapsed = block.cycles + stalls;
+        auto pending       = block.tail;
+        for (std::size_t i = 0; i < this->pending.count; ++i) {
+            const auto [reg, left] = this->pending.list[i];
+            if (left > elapsed && (block.written >> reg & 1) == 0)
+                pending.push({reg, std::uint8_t(left - elapsed)});
+        }
+
+        this->pending = pending;
+        this->stalls += stalls;
+    }
+
+private:
+    target_size_t next = 0;
+    Carried pending{};
+};
+
+} // namespace dark::pipeline
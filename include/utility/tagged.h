@@ -33,6 +33,11 @@ static auto visit(_F &&f, const tagged<_Base...> &x) -> void {
     (f(static_cast<const _Base &>(x)), ...);
 }
 
+template <typename _F, typename... _Base>
+static auto visit(_F &&f, tagged<_Base...> &x, const tagged<_Base...> &y) -> void {
+    (f(static_cast<_Base &>(x), static_cast<const _Base &>(y)), ...);
+}
+
 template <typename _F, typename... _Base>
 static auto visit(_F &&f, const tagged<_Base...> &x, const tagged<_Base...> &y) -> void {
     (f(static_cast<const _Base &>(x), static_cast<const _Base &>(y)), ...);
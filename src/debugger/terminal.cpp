@@ -11,6 +11,7 @@
 #include "utility/error.h"
 #include "utility/hash.h"
 #include <cstddef>
+#include <cstring>
 #include <iostream>
 #include <ranges>
 
@@ -89,20 +90,16 @@ void DebugManager::print_info_dispatch(const DisplayInfo &info) {
             alignof(decltype(data))
         );
 
+        static_assert(std::integral<decltype(data)>);
+        const auto *raw = d.mem.read_range(pos, cnt * sizeof(data));
+        panic_if(
+            raw == nullptr, "Data is out of range: [{:#x}, {:#x})", pos, pos + cnt * sizeof(data)
+        );
+
         for (std::size_t i = 0; i < cnt; ++i) {
-            target_ssize_t loaded{};
             target_ssize_t addr = pos + i * sizeof(data);
-
-            static_assert(std::integral<decltype(data)>);
-            if constexpr (sizeof(data) == 4) {
-                loaded = d.mem.load_i32(addr);
-            } else if constexpr (sizeof(data) == 2) {
-                loaded = d.mem.load_i16(addr);
-            } else if constexpr (sizeof(data) == 1) {
-                loaded = d.mem.load_i8(addr);
-            } else {
-                unreachable("Unsupported data size");
-            }
+            std::memcpy(&data, raw + i * sizeof(data), sizeof(data));
+            target_ssize_t loaded = data;
 
             message << fmt::format("{}\t {}", d.pretty_address(addr), loaded) << std::endl;
         }
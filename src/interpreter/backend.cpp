@@ -11,33 +11,58 @@
 #include "linker/layout.h"
 #include "simulation/debug.h"
 #include "simulation/icache.h"
+#include "simulation/jit.h"
+#include "simulation/mmio.h"
 #include "utility/error.h"
+#include <algorithm>
 #include <cstddef>
+#include <limits>
 #include <ostream>
+#include <string>
+#include <string_view>
 
 namespace dark {
 
-static void simulate_normal(RegisterFile &, Memory &, Device &, std::size_t);
-static void simulate_debug(RegisterFile &, Memory &, Device &, std::size_t, MemoryLayout &);
+template <bool, bool>
+static void
+simulate_normal(RegisterFile &, Memory &, Device &, std::size_t, bool, const MemoryLayout &);
+static void
+simulate_debug(RegisterFile &, Memory &, Device &, std::size_t, bool, MemoryLayout &);
 
 void Interpreter::simulate() {
     auto &layout = this->memory_layout.get<MemoryLayout &>();
+    auto &image  = this->memory_image.get<std::shared_ptr<const Memory::Image> &>();
 
     auto device_ptr = Device::create(config);
-    auto memory_ptr = Memory::create(config, layout);
+    auto memory_ptr = Memory::create(config, layout, *image);
 
     auto &device = *device_ptr;
     auto &memory = *memory_ptr;
 
+    auto devices = mmio::Devices{memory, device};
     auto regfile = RegisterFile{layout.position_table.at("main"), config};
 
     libc::libc_init(regfile, memory, device);
 
     if (config.has_option("debug")) {
         // Avoid inlining those cold functions.
-        [[unlikely]] simulate_debug(regfile, memory, device, config.get_timeout(), layout);
+        [[unlikely]] simulate_debug(
+            regfile, memory, device, config.get_timeout(), config.has_option("icache"), layout
+        );
     } else {
-        simulate_normal(regfile, memory, device, config.get_timeout());
+        const bool predecode = config.has_option("predecode");
+        const auto timeout   = config.get_timeout();
+        // The instruction cache and the pipeline are fed from the loop,
+        // so they cost nothing when disabled.
+        using Simulate_t                  = decltype(simulate_normal<false, false>);
+        constexpr Simulate_t *kSimulate[] = {
+            simulate_normal<false, false>,
+            simulate_normal<false, true>,
+            simulate_normal<true, false>,
+            simulate_normal<true, true>,
+        };
+        const auto which = config.has_option("icache") * 2 + config.has_option("pipeline");
+        kSimulate[which](regfile, memory, device, timeout, predecode, layout);
     }
 
     console::flush_stdout();
@@ -49,16 +74,151 @@ void Interpreter::simulate() {
     device.print_details(enable_detail);
 }
 
-static void simulate_normal(RegisterFile &rf, Memory &mem, Device &dev, std::size_t timeout) {
+/**
+ * The last dispatch of a block. Normally it is the last command, unless
+ * the block ends with a fused pair, which also runs the last command.
+ */
+static auto final_of(const Executable *entry, std::size_t count) -> std::size_t {
+    using Fusion = Executable::MetaData::Fusion;
+    if (count >= 2 && entry[count - 2].get_meta().fusion == Fusion::Control)
+        return count - 2;
+    return count - 1;
+}
+
+#if defined(REIMU_THREADED_DISPATCH)
+
+// Bound the chain, so that the native stack will not overflow
+// even if the compiler fails to turn the jumps into tail calls.
+static constexpr std::size_t kMaxDispatch = 1024;
+
+/**
+ * Run the first count commands of a block in one dispatch.
+ *
+ * Each command jumps to the next one directly by tail call, until the
+ * chain runs out. The pc is moved to the last dispatch in advance, and
+ * is moved back to the failing command if something goes wrong.
+ */
+static auto
+run_block(Executable *entry, std::size_t count, RegisterFile &rf, Memory &mem, Device &dev)
+    -> Hint {
+    const auto last = final_of(entry, count);
+    rf.advance_by(last);
+    rf.set_chain(last);
+    try {
+        return (*entry)(rf, mem, dev);
+    } catch (FailToInterpret &) {
+        rf.rewind_chain();
+        throw;
+    }
+}
+
+#else
+
+static constexpr std::size_t kMaxDispatch = std::numeric_limits<std::size_t>::max();
+
+/**
+ * Run the first count commands of a block in one dispatch.
+ *
+ * Only the last dispatch may leave the block, so the commands before it
+ * can run back-to-back without pc bookkeeping. The pc is only moved
+ * forward before the last dispatch, or when some command fails,
+ * so that the error is reported at the right place.
+ *
+ * A fused pair before the last dispatch may cover the last command,
+ * in which case there is nothing left to run.
+ */
+static auto
+run_block(Executable *entry, std::size_t count, RegisterFile &rf, Memory &mem, Device &dev)
+    -> Hint {
+    const auto last = final_of(entry, count);
+    const auto stop = entry + last;
+    auto *exe       = entry;
+    try {
+        while (exe < stop) {
+            exe                = (*exe)(rf, mem, dev).next;
+            rf[Register::zero] = 0;
+        }
+    } catch (FailToInterpret &) {
+        rf.advance_by(exe - entry);
+        throw;
+    }
+    rf.advance_by(last);
+    return exe == stop ? (*stop)(rf, mem, dev) : Hint{exe};
+}
+
+#endif
+
+/**
+ * The function holding the pc, i.e. the closest label before it, local ones
+ * included, as functions need not be global. Labels starting with '.' are
+ * only branch targets inside a function.
+ */
+static auto function_of(const MemoryLayout &layout, target_size_t pc) -> std::string {
+    auto result     = std::string_view{"??"};
+    auto best       = target_size_t{};
+    const auto find = [&](const auto &table) {
+        for (const auto &[label, pos] : table) {
+            if (pos <= pc && pos >= best && !label.starts_with('.')) {
+                result = label;
+                best   = pos;
+            }
+        }
+    };
+    find(layout.position_table);
+    find(layout.local_table);
+    return fmt::format("{} (pc = 0x{:x})", result, pc);
+}
+
+/* Whether the run of commands is in the text section, but not in libc. */
+static auto in_text(target_size_t pc) -> bool {
+    return pc >= libc::kLibcEnd;
+}
+
+template <bool kFetch, bool kPipeline>
+static void simulate_normal(
+    RegisterFile &rf, Memory &mem, Device &dev, std::size_t timeout, bool predecode,
+    const MemoryLayout &layout
+) {
     ICache icache{mem};
+    if (predecode)
+        icache.predecode(mem, dev);
+#if defined(REIMU_JIT)
+    JitTier jit{mem};
+#endif
     try {
         Hint hint{};
-        while (rf.advance() && timeout-- > 0) {
-            auto &exe = icache.ifetch(rf.get_pc(), hint);
-            hint      = exe(rf, mem, dev);
+        while (rf.advance()) {
+            panic_if(timeout == 0, "Time Limit Exceeded");
+            auto [entry, count] = icache.bfetch(rf.get_pc(), hint, mem, dev);
+            if (const auto limit = std::min(timeout, kMaxDispatch); count > limit) {
+                // A fused pair must not run past the limit.
+                count = limit;
+                icache.cut(entry[count - 1], mem, dev);
+            }
+            timeout -= count;
+            // Counted in advance. If anything goes wrong, no counter is reported.
+            icache.record(entry, count, mem, dev);
+            if constexpr (kFetch)
+                if (in_text(rf.get_pc()))
+                    dev.fetch(rf.get_pc(), static_cast<target_size_t>(count));
+            // Calls into libc are charged by the libc weights alone.
+            if constexpr (kPipeline)
+                if (in_text(rf.get_pc()))
+                    icache.issue(rf.get_pc(), count);
+#if defined(REIMU_JIT)
+            // The native tier always leaves at least one command to the interpreter.
+            if (const auto done = jit.run(rf, mem, dev, count)) {
+                rf.advance_by(done);
+                entry += done;
+                count -= done;
+            }
+#endif
+            hint = run_block(entry, count, rf, mem, dev);
         }
-        panic_if(timeout + 1 == 0, "Time Limit Exceeded");
+        icache.commit(dev);
     } catch (FailToInterpret &e) {
+        if (e.error == Error::StackOverflow)
+            e.message = function_of(layout, rf.get_pc());
         panic("Fail to execute the program.\n  {}", e.what(rf, mem, dev));
     } catch (std::exception &e) {
         unreachable(fmt::format("std::exception caught: {}\n", e.what()));
@@ -66,7 +226,8 @@ static void simulate_normal(RegisterFile &rf, Memory &mem, Device &dev, std::siz
 }
 
 static void simulate_debug(
-    RegisterFile &rf, Memory &mem, Device &dev, std::size_t timeout, MemoryLayout &layout
+    RegisterFile &rf, Memory &mem, Device &dev, std::size_t timeout, bool fetch,
+    MemoryLayout &layout
 ) {
     ICache icache{mem};
     DebugManager manager{rf, mem, dev, layout};
@@ -87,15 +248,21 @@ static void simulate_debug(
         Hint hint{};
         while (rf.advance() && timeout-- > 0) {
             manager.attach();
+            if (fetch && in_text(rf.get_pc()))
+                dev.fetch(rf.get_pc(), 1);
             auto &exe = icache.ifetch(rf.get_pc(), hint);
             hint      = exe(rf, mem, dev);
+            icache.record(&exe, 1, mem, dev);
         }
         panic_if(timeout + 1 == 0, "Time Limit Exceeded");
+        icache.commit(dev);
 
         guard.manager = nullptr;
         console::message << "[Debugger] normal exit after " << manager.get_step() << " steps"
                          << std::endl;
     } catch (FailToInterpret &e) {
+        if (e.error == Error::StackOverflow)
+            e.message = function_of(layout, rf.get_pc());
         panic("Fail to execute the program.\n  {}", e.what(rf, mem, dev));
     } catch (std::exception &e) {
         unreachable(fmt::format("std::exception caught: {}\n", e.what()));
@@ -1,13 +1,22 @@
 #include "interpreter/device.h"
+#include "config/cache.h"
 #include "config/config.h"
 #include "config/counter.h"
+#include "config/predictor.h"
 #include "declarations.h"
+#include "interpreter/executable.h"
+#include "libc/libc.h"
 #include "simulation/dcache.h"
 #include "simulation/predictor.h"
 #include "utility/misc.h"
 #include "utility/tagged.h"
+#include <algorithm>
 #include <cstddef>
+#include <functional>
+#include <memory>
 #include <optional>
+#include <span>
+#include <vector>
 
 namespace dark {
 
@@ -19,14 +28,38 @@ static auto operator*(const weight::Counter &lhs, const weight::Counter &rhs) ->
     return sum;
 }
 
+// A block, with the cycles it takes without any timing model.
+struct Hotspot {
+    Device::Block block;
+    std::size_t cycles;
+};
+
+// The last run of commands fetched, if all of its lines were hits.
+struct Fetch {
+    target_size_t pc;
+    target_size_t count;
+    std::size_t lines;
+};
+
+// Jumps by jal and jalr, and how many of them have the target predicted.
+struct Jumps {
+    std::size_t total;
+    std::size_t success;
+};
+
 // Some hidden implementation data.
 struct Device_Impl {
     std::size_t bp_success;
-    std::size_t cache_load;
-    std::size_t cache_store;
     const Config &config;
-    std::optional<BranchPredictor> bp;
-    std::optional<kupi::Cache> cache;
+    std::unique_ptr<BranchPredictor> bp;
+    std::optional<TargetPredictor> tp;
+    Jumps jumps;
+    Jumps returns;
+    std::optional<cache::Hierarchy> cache;
+    std::optional<cache::Storage> icache;
+    bool pipeline;
+    Fetch last_fetch;
+    std::vector<Hotspot> hotspots;
 };
 
 struct Device::Impl : Device, Device_Impl {
@@ -37,17 +70,27 @@ struct Device::Impl : Device, Device_Impl {
             .out     = config.get_output_stream(),
         },
         Device_Impl{
-            .bp_success  = 0,
-            .cache_load  = 0,
-            .cache_store = 0,
-            .config      = config,
-            .bp          = {},
-            .cache       = {},
+            .bp_success = 0,
+            .config     = config,
+            .bp         = {},
+            .tp         = {},
+            .jumps      = {},
+            .returns    = {},
+            .cache      = {},
+            .icache     = {},
+            // Blocks are never run as a whole by the debugger.
+            .pipeline   = config.has_option("pipeline") && !config.has_option("debug"),
+            .last_fetch = {},
+            .hotspots   = {},
         } {
         if (config.has_option("predictor"))
-            bp.emplace();
+            bp = BranchPredictor::create(config.get_predictor());
+        if (config.has_option("btb"))
+            tp.emplace();
         if (config.has_option("cache"))
-            cache.emplace();
+            cache.emplace(config.get_cache_levels());
+        if (config.has_option("icache"))
+            icache.emplace(config.get_icache_level());
     }
 };
 
@@ -55,8 +98,28 @@ auto Device::create(const Config &config) -> unique_t {
     return unique_t{new Device::Impl{config}};
 }
 
+auto Device::get_model() const -> Model {
+    auto &impl = *static_cast<const Impl *>(this);
+    return Model{
+        .cache     = impl.cache.has_value(),
+        .predictor = impl.bp != nullptr,
+        .target    = impl.tp.has_value(),
+        .pipeline  = impl.pipeline,
+    };
+}
+
+/* Add the counters of a block, which are also kept for the hotspot report. */
+void Device::add_block(Block block, const weight::Counter &counter) {
+    auto &impl = this->get_impl();
+    visit(
+        [](auto &lhs, auto &rhs) { lhs.set_weight(lhs.get_weight() + rhs.get_weight()); },
+        static_cast<weight::Counter &>(impl.counter), counter
+    );
+    impl.hotspots.push_back({.block = block, .cycles = counter * impl.config.get_weight()});
+}
+
 void Device::predict(target_size_t pc, bool what) {
-    if (auto &impl = this->get_impl(); impl.bp.has_value()) {
+    if (auto &impl = this->get_impl(); impl.bp != nullptr) {
         auto &bp    = *impl.bp;
         auto result = bp.predict(pc);
         impl.bp_success += (result == what);
@@ -64,26 +127,121 @@ void Device::predict(target_size_t pc, bool what) {
     }
 }
 
-void Device::try_load(target_size_t addr, target_size_t size) {
-    if (auto &impl = this->get_impl(); impl.cache.has_value()) {
-        auto &cache = *impl.cache;
-        impl.cache_load += cache.load(addr, addr + size);
-    }
+/**
+ * Predict the target of a jal or jalr, which is only done with --btb.
+ * A call into the libc never returns by a jalr, so it is not pushed.
+ * Each target missed costs one TargetMiss.
+ */
+void Device::jump(target_size_t pc, target_size_t target, predictor::Jump kind) {
+    auto &impl = this->get_impl();
+    if (kind == predictor::Jump::Call && target < libc::kLibcEnd)
+        kind = predictor::Jump::Other;
+
+    const bool hit = impl.tp->predict(pc, target, kind);
+    auto &jumps    = kind == predictor::Jump::Return ? impl.returns : impl.jumps;
+    jumps.total += 1;
+    jumps.success += hit;
+    if (!hit)
+        this->counter.wTargetMiss += 1;
+}
+
+// An access never crosses a line, since it is aligned and a line is at least a word.
+void Device::try_load(target_size_t addr, target_size_t) {
+    if (auto &impl = this->get_impl(); impl.cache.has_value())
+        impl.cache->load(addr);
 }
 
-void Device::try_store(target_size_t addr, target_size_t size) {
-    if (auto &impl = this->get_impl(); impl.cache.has_value()) {
-        auto &cache = *impl.cache;
-        impl.cache_store += cache.store(addr, addr + size);
+void Device::try_store(target_size_t addr, target_size_t) {
+    if (auto &impl = this->get_impl(); impl.cache.has_value())
+        impl.cache->store(addr);
+}
+
+/**
+ * Fetch a run of commands, which is only done with --icache, once on
+ * the entry of each block. Each line missed costs one ICacheMiss.
+ *
+ * If all the lines of a run are hits, running it again right after is
+ * also all hits, and leaves the replacement state as it is. So a loop
+ * of one block only looks up its lines once.
+ */
+void Device::fetch(target_size_t pc, target_size_t count) {
+    auto &impl   = this->get_impl();
+    auto &icache = *impl.icache;
+    auto &last   = impl.last_fetch;
+    if (last.pc == pc && last.count == count && last.lines != 0) [[likely]]
+        return void(icache.stats.load_hit += last.lines);
+
+    const auto line  = static_cast<target_size_t>(icache.level.line);
+    const auto first = pc / line * line;
+    const auto limit = pc + count * sizeof(command_size_t);
+
+    bool all_hit      = true;
+    std::size_t lines = 0;
+    for (auto addr = first; addr < limit; addr += line, ++lines) {
+        if (icache.access(addr, false)) {
+            icache.stats.load_hit += 1;
+        } else {
+            icache.stats.load_miss += 1;
+            icache.fill(addr, false);
+            this->counter.wICacheMiss += 1;
+            all_hit = false;
+        }
     }
+
+    last = {.pc = pc, .count = count, .lines = all_hit ? lines : 0};
 }
 
 auto Device::get_impl() -> Impl & {
     return *static_cast<Impl *>(this);
 }
 
+static auto get_name(predictor::Kind kind) -> std::string_view {
+    switch (kind) {
+        case predictor::Kind::Bimodal:    return "bimodal";
+        case predictor::Kind::Gshare:     return "gshare";
+        case predictor::Kind::Tournament: return "tournament";
+        case predictor::Kind::Tage:       return "tage";
+        default:                          unreachable();
+    }
+}
+
+/* The hottest blocks, by the cycles they take without any timing model. */
+static void print_hotspots(std::vector<Hotspot> hotspots, std::size_t total) {
+    constexpr std::size_t kMaxReport = 10;
+
+    const auto count = std::min(hotspots.size(), kMaxReport);
+    std::ranges::partial_sort(hotspots, hotspots.begin() + count, std::greater{}, &Hotspot::cycles);
+
+    profile << "Hottest blocks:\n";
+    for (const auto &[block, cycles] : std::span{hotspots}.first(count)) {
+        const auto last = block.pc + (block.length - 1) * sizeof(command_size_t);
+        profile << fmt::format(
+            "# {:#010x} - {:#010x}: {} cycles ({:.2f}%), run {} times\n", block.pc, last, cycles,
+            100.0 * cycles / std::max<std::size_t>(total, 1), block.times
+        );
+    }
+}
+
+/* Hit rate of each level, the first over all the loads and stores. */
+static void print_cache(const cache::Hierarchy &cache) {
+    const auto levels = cache.get_levels();
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+        const auto &[load_hit, load_miss, store_hit, store_miss] = levels[i].stats;
+
+        const auto hits = load_hit + store_hit;
+        if (auto total = hits + load_miss + store_miss) {
+            profile << fmt::format(
+                "{} hit rate: {:.2f}% ({}/{})\n", i == 0 ? "Cache" : "L2 cache",
+                100.0 * hits / total, hits, total
+            );
+        }
+    }
+    profile << fmt::format(
+        "Cache lines from memory: {}, to memory: {}\n", cache.get_load(), cache.get_store()
+    );
+}
+
 void Device::print_details(bool details) const {
-    allow_unused(details);
     auto &impl = *static_cast<const Impl *>(this);
 
     const auto &kWeight = impl.config.get_weight();
@@ -93,21 +251,25 @@ void Device::print_details(bool details) const {
     auto cycles = counter * kWeight;
     cycles += counter.libcMem.weight + counter.libcIO.weight + counter.libcOp.weight;
 
-    if (impl.bp.has_value()) {
+    if (impl.bp != nullptr) {
         cycles -= impl.bp_success * kWeight.wBranch;
         cycles += impl.bp_success * kWeight.wPredictTaken;
     }
 
+    // Each hit costs the latency of its level, and each line to or from the memory
+    // costs the weight of a load or a store.
     if (impl.cache.has_value()) {
         cycles -= counter.wLoad * kWeight.wLoad;
         cycles -= counter.wStore * kWeight.wStore;
-        const auto load  = impl.cache->get_load();
-        const auto store = impl.cache->get_store();
 
-        cycles += load * kWeight.wLoad;
-        cycles += store * kWeight.wStore;
-        cycles += impl.cache_load * kWeight.wCacheLoad;
-        cycles += impl.cache_store * kWeight.wCacheStore;
+        for (const auto &level : impl.cache->get_levels()) {
+            const auto &stats = level.stats;
+            cycles += stats.load_hit * level.level.latency.value_or(kWeight.wCacheLoad);
+            cycles += stats.store_hit * level.level.latency.value_or(kWeight.wCacheStore);
+        }
+
+        cycles += impl.cache->get_load() * kWeight.wLoad;
+        cycles += impl.cache->get_store() * kWeight.wStore;
     }
 
     profile << fmt::format("Total cycles: {}\n", cycles);
@@ -137,24 +299,58 @@ void Device::print_details(bool details) const {
         counter.libcOp.count            // libcOp
     );
 
-    if (impl.bp.has_value()) {
+    if (impl.bp != nullptr) {
         if (auto total = counter.wBranch) {
             profile << fmt::format(
-                "Branch prediction taken rate: {:.2f}% ({}/{})\n", 100.0 * impl.bp_success / total,
-                impl.bp_success, total
+                "Branch prediction taken rate: {:.2f}% ({}/{}) by {}\n",
+                100.0 * impl.bp_success / total, impl.bp_success, total,
+                get_name(impl.config.get_predictor())
             );
         }
     }
 
-    if (impl.cache.has_value()) {
-        if (auto total = counter.wLoad + counter.wStore) {
+    if (impl.tp.has_value()) {
+        for (auto [name, jumps] : {
+                 std::pair{"Jump target", impl.jumps},
+                 std::pair{"Return address", impl.returns},
+             }) {
+            if (auto total = jumps.total) {
+                profile << fmt::format(
+                    "{} prediction rate: {:.2f}% ({}/{})\n", name,
+                    100.0 * jumps.success / total, jumps.success, total
+                );
+            }
+        }
+    }
+
+    if (impl.cache.has_value())
+        print_cache(*impl.cache);
+
+    if (impl.icache.has_value()) {
+        const auto &stats = impl.icache->stats;
+        if (auto total = stats.load_hit + stats.load_miss) {
             profile << fmt::format(
-                "Cache hit rate: {:.2f}% ({}/{})\n",
-                100.0 * (impl.cache_load + impl.cache_store) / total,
-                impl.cache_load + impl.cache_store, total
+                "Instruction cache hit rate: {:.2f}% ({}/{})\n", 100.0 * stats.load_hit / total,
+                stats.load_hit, total
             );
         }
     }
+
+    if (impl.pipeline) {
+        profile << fmt::format(
+            "Pipeline stalls: {}, flushes: {}\n", counter.wStall, counter.wFlush
+        );
+    }
+
+    if (details) {
+        profile << fmt::format(
+            "Decoded footprint: {} bytes ({} bytes each)\n",
+            impl.counter.iparse * sizeof(Executable), sizeof(Executable)
+        );
+    }
+
+    if (details && !impl.hotspots.empty())
+        print_hotspots(impl.hotspots, counter * kWeight);
 }
 
 } // namespace dark
@@ -8,7 +8,7 @@
 
 namespace dark {
 
-auto FailToInterpret::what(RegisterFile &rf, Memory &, Device &) const -> std::string {
+auto FailToInterpret::what(RegisterFile &rf, Memory &mem, Device &) const -> std::string {
     const auto __misaligned = [this](auto &&type) {
         return fmt::format(
             "{} misaligned at 0x{:x} | alignment = {}", type, this->detail.address,
@@ -45,6 +45,14 @@ auto FailToInterpret::what(RegisterFile &rf, Memory &, Device &) const -> std::s
         case OutOfMemory:
             return fmt::format("Out of memory! Trying to allocate {} bytes", this->detail.size);
 
+        case StackOverflow: {
+            const auto depth = mem.get_stack_end() - this->detail.address;
+            auto where       = this->message.empty() ? "" : fmt::format(" | in {}", this->message);
+            return fmt::format(
+                "Stack overflow at 0x{:x} | depth = {} bytes{}", this->detail.address, depth, where
+            );
+        }
+
         case LibcError:      return fmt::format("{}: {}", __libc_name(), this->message);
         case NotImplemented: return "Not implemented";
 
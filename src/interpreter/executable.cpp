@@ -7,12 +7,27 @@
 #include "interpreter/register.h"
 #include "riscv/command.h"
 #include "simulation/executable.h"
+#include <algorithm>
+#include <optional>
+#include <span>
+
+#if defined(REIMU_COMPACT_EXECUTABLE)
+#include "utility/error.h"
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#endif
 
 namespace dark {
 
 using _Pair_t = std::pair<Function_t *, Executable::MetaData>;
 
-static auto parse_cmd(command_size_t cmd) -> _Pair_t;
+using _Model_t   = Device::Model;
+using _Counter_t = std::size_t weight::Counter::*;
+
+static auto parse_cmd(command_size_t cmd, target_size_t pc, _Model_t) -> _Pair_t;
+static auto fuse_cmd(command_size_t, command_size_t, target_size_t, _Model_t)
+    -> std::optional<_Pair_t>;
 
 template <Error error = Error::InsUnknown>
 [[noreturn]]
@@ -29,6 +44,36 @@ auto Executable::fn(Executable &, RegisterFile &, Memory &, Device &) -> Hint {
     unreachable();
 }
 
+#if defined(REIMU_COMPACT_EXECUTABLE)
+
+/**
+ * Only a few hundred distinct functions exist, so the table never grows large.
+ * Lookups may come from several predecode threads at the same time, while
+ * the dispatch itself reads the table without any lock, which is safe since
+ * an entry is never modified once published and all the threads are joined
+ * before the first command is executed.
+ */
+auto Executable::index_of(_Func_t *func) -> std::uint32_t {
+    static std::shared_mutex mutex;
+    static std::unordered_map<_Func_t *, std::uint32_t> map{{fn, 0}};
+
+    {
+        std::shared_lock lock{mutex};
+        if (auto iter = map.find(func); iter != map.end())
+            return iter->second;
+    }
+
+    std::unique_lock lock{mutex};
+    const auto [iter, success] = map.try_emplace(func, map.size());
+    if (success) {
+        runtime_assert(iter->second < std::size(table));
+        table[iter->second] = func;
+    }
+    return iter->second;
+}
+
+#endif // REIMU_COMPACT_EXECUTABLE
+
 /**
  * A function which will parse the command at runtime,
  * and reset the executable function pointer.
@@ -43,12 +88,245 @@ auto compile_once(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) -
 
     const auto cmd = mem.load_cmd(pc);
 
-    const auto [func, data] = parse_cmd(cmd);
+    const auto [func, data] = parse_cmd(cmd, pc, dev.get_model());
     exe.set_handle(func, data);
 
     return exe(rf, mem, dev);
 }
 
+/**
+ * Parse a straight-line run of commands.
+ *
+ * The run stops right after a branch/jal/jalr, which is the only way
+ * to leave the run, or right before an unknown command, which is left
+ * as compile_once, so that the error is reported only when executed.
+ */
+static auto parse_block(std::span<Executable> text, target_size_t pc, Memory &mem, Device &dev)
+    -> std::size_t {
+    std::size_t count = 0;
+    const auto model  = dev.get_model();
+    for (auto &exe : text) {
+        const auto cmd = mem.load_cmd(pc);
+
+        if (exe.get_func() == compile_once) {
+            try {
+                const auto [func, data] = parse_cmd(cmd, pc, model);
+                exe.set_handle(func, data);
+            } catch (FailToInterpret &) { break; }
+            dev.counter.iparse += 1;
+        }
+
+        count += 1;
+        pc += sizeof(command_size_t);
+
+        switch (command::get_opcode(cmd)) {
+            case command::b_type::opcode:
+            case command::jal::opcode:
+            case command::jalr::opcode: return count;
+            default:                    break;
+        }
+    }
+    return count;
+}
+
+/**
+ * Translate a straight-line run of commands before its first execution.
+ *
+ * Common pairs in the run are then fused into one command. The fused
+ * command is installed in place of the first one, while the second one
+ * is kept as is, since it may still be the target of some jump.
+ *
+ * Return the length of the run, which is at least 1.
+ */
+auto compile_block(std::span<Executable> text, target_size_t pc, Memory &mem, Device &dev)
+    -> std::size_t {
+    const auto count = parse_block(text, pc, mem, dev);
+    const auto model = dev.get_model();
+
+    for (std::size_t i = 0; i + 1 < count; ++i) {
+        auto &exe = text[i];
+        if (exe.get_meta().fusion != Executable::MetaData::Fusion::None)
+            continue; // Fused by some other block already.
+        const auto where = pc + i * sizeof(command_size_t);
+        const auto first = mem.load_cmd(where);
+        const auto next  = mem.load_cmd(where + sizeof(command_size_t));
+        if (const auto fused = fuse_cmd(first, next, where, model))
+            exe.set_handle(fused->first, fused->second);
+    }
+
+    return std::max<std::size_t>(count, 1);
+}
+
+/**
+ * Parse all the commands in the text ahead of time.
+ * Unknown commands are left as compile_once, just as the lazy path.
+ *
+ * It only reads the memory and writes to the given slots, so disjoint
+ * ranges can be decoded in parallel. Return the number of parsed commands.
+ */
+auto predecode(std::span<Executable> text, target_size_t pc, Memory &mem, _Model_t model)
+    -> std::size_t {
+    std::size_t count = 0;
+    for (auto &exe : text) {
+        try {
+            const auto [func, data] = parse_cmd(mem.load_cmd(pc), pc, model);
+            exe.set_handle(func, data);
+            count += 1;
+        } catch (FailToInterpret &) {}
+        pc += sizeof(command_size_t);
+    }
+    return count;
+}
+
+/**
+ * Undo the fusion of a command, so that it only executes itself.
+ * This is needed when a block has to stop right after it.
+ */
+void unfuse_once(Executable &exe, target_size_t pc, Memory &mem, _Model_t model) {
+    const auto [func, data] = parse_cmd(mem.load_cmd(pc), pc, model);
+    exe.set_handle(func, data);
+}
+
+template <general::ArithOp cmp, general::BranchOp op>
+static auto make_fused_branch(Executable::MetaData arg, _Model_t model) -> _Pair_t {
+    if (model.predictor)
+        return {interpreter::Fused::branch<cmp, op, true>, arg};
+    return {interpreter::Fused::branch<cmp, op, false>, arg};
+}
+
+/**
+ * Try to fuse two adjacent commands into one.
+ * All supported pairs never throw, so no error can happen in the middle.
+ */
+static auto fuse_cmd(command_size_t first, command_size_t next, target_size_t pc, _Model_t model)
+    -> std::optional<_Pair_t> {
+    using Fusion = Executable::MetaData::Fusion;
+
+    const auto op_0 = command::get_opcode(first);
+    const auto op_1 = command::get_opcode(next);
+
+    // lui/auipc rd, hi + addi rd, rd, lo
+    if ((op_0 == command::lui::opcode || op_0 == command::auipc::opcode)
+        && op_1 == command::i_type::opcode) {
+        auto upper = command::lui::from_integer(first); // Same layout as auipc
+        auto addi  = command::i_type::from_integer(next);
+        if (addi.funct3 != command::i_type::Funct3::ADD || upper.rd == 0 || addi.rd != upper.rd
+            || addi.rs1 != upper.rd)
+            return std::nullopt;
+        auto imm = upper.get_imm() + addi.get_imm();
+        if (op_0 == command::auipc::opcode)
+            imm += pc;
+        const auto arg = Executable::MetaData{
+            .rd = int_to_reg(upper.rd), .fusion = Fusion::Straight, .imm = imm
+        };
+        return _Pair_t{interpreter::Fused::li, arg};
+    }
+
+    // slli rd, rs1, imm + add rd, rd, rs2 (or add rd, rs2, rd)
+    if (op_0 == command::i_type::opcode && op_1 == command::r_type::opcode) {
+        auto slli = command::i_type::from_integer(first);
+        auto add  = command::r_type::from_integer(next);
+        if (slli.funct3 != command::i_type::Funct3::SLL
+            || command::get_funct7(first) != command::i_type::Funct7::SLL
+            || add.funct3 != command::r_type::Funct3::ADD
+            || add.funct7 != command::r_type::Funct7::ADD || slli.rd == 0 || add.rd != slli.rd)
+            return std::nullopt;
+        const auto rs2 = add.rs1 == slli.rd ? add.rs2 : add.rs1;
+        if ((add.rs1 != slli.rd && add.rs2 != slli.rd) || rs2 == slli.rd)
+            return std::nullopt;
+        const auto arg = Executable::MetaData{
+            .rd     = int_to_reg(slli.rd),
+            .rs1    = int_to_reg(slli.rs1),
+            .rs2    = int_to_reg(rs2),
+            .fusion = Fusion::Straight,
+            .imm    = slli.get_imm(),
+        };
+        return _Pair_t{interpreter::Fused::shadd, arg};
+    }
+
+    // auipc rs1, hi + jalr rd, lo(rs1)
+    if (op_0 == command::auipc::opcode && op_1 == command::jalr::opcode) {
+        auto auipc = command::auipc::from_integer(first);
+        auto jalr  = command::jalr::from_integer(next);
+        if (auipc.rd == 0 || jalr.rs1 != auipc.rd)
+            return std::nullopt;
+        const auto arg = Executable::MetaData{
+            .rd     = int_to_reg(jalr.rd),
+            .rs1    = int_to_reg(auipc.rd),
+            .fusion = Fusion::Control,
+            .imm    = auipc.get_imm() + jalr.get_imm(),
+        };
+        if (model.target)
+            return _Pair_t{interpreter::Fused::call<true>, arg};
+        return _Pair_t{interpreter::Fused::call<false>, arg};
+    }
+
+    // slt(u) rd, rs1, rs2 + beqz/bnez rd, imm
+    if (op_0 == command::r_type::opcode && op_1 == command::b_type::opcode) {
+        auto slt    = command::r_type::from_integer(first);
+        auto branch = command::b_type::from_integer(next);
+        const bool is_zero = (branch.rs1 == slt.rd && branch.rs2 == 0)
+                          || (branch.rs2 == slt.rd && branch.rs1 == 0);
+        if (slt.rd == 0 || !is_zero || slt.funct7 != command::r_type::Funct7::SLT)
+            return std::nullopt;
+        const auto arg = Executable::MetaData{
+            .rd     = int_to_reg(slt.rd),
+            .rs1    = int_to_reg(slt.rs1),
+            .rs2    = int_to_reg(slt.rs2),
+            .fusion = Fusion::Control,
+            .imm    = branch.get_imm(),
+        };
+
+        using enum general::ArithOp;
+        using enum general::BranchOp;
+        using Funct3 = command::r_type::Funct3;
+        using BFunct = command::b_type::Funct3;
+        if (slt.funct3 == Funct3::SLT && branch.funct3 == BFunct::BEQ)
+            return make_fused_branch<SLT, BEQ>(arg, model);
+        if (slt.funct3 == Funct3::SLT && branch.funct3 == BFunct::BNE)
+            return make_fused_branch<SLT, BNE>(arg, model);
+        if (slt.funct3 == Funct3::SLTU && branch.funct3 == BFunct::BEQ)
+            return make_fused_branch<SLTU, BEQ>(arg, model);
+        if (slt.funct3 == Funct3::SLTU && branch.funct3 == BFunct::BNE)
+            return make_fused_branch<SLTU, BNE>(arg, model);
+    }
+
+    return std::nullopt;
+}
+
+/**
+ * Pick a cheaper handler for the common forms when possible.
+ * Writes to zero do nothing at all, unless the command may throw.
+ */
+template <general::ArithOp op>
+static auto make_arith_reg(Executable::MetaData arg) -> _Pair_t {
+    using enum general::ArithOp;
+    if constexpr (op != DIV && op != DIVU && op != REM && op != REMU)
+        if (arg.rd == Register::zero)
+            return {interpreter::ArithNop::fn<op>, arg};
+    return {interpreter::ArithReg::fn<op>, arg};
+}
+
+/**
+ * Besides writes to zero, li (rs1 == zero) is folded into a constant,
+ * and mv (imm == 0 with an identity operation) is a plain copy.
+ */
+template <general::ArithOp op>
+static auto make_arith_imm(Executable::MetaData arg) -> _Pair_t {
+    using enum general::ArithOp;
+    constexpr bool identity = op == ADD || op == OR || op == XOR || op == SLL || op == SRL
+                           || op == SRA;
+    if (arg.rd == Register::zero)
+        return {interpreter::ArithNop::fn<op>, arg};
+    if (arg.rs1 == Register::zero) {
+        arg.imm = interpreter::__details::arith_eval<op>(0, arg.imm);
+        return {interpreter::ArithImm::li<op>, arg};
+    }
+    if (identity && arg.imm == 0)
+        return {interpreter::ArithImm::mv<op>, arg};
+    return {interpreter::ArithImm::fn<op>, arg};
+}
+
 static auto parse_r_type(command_size_t cmd) -> _Pair_t {
     auto r_type = command::r_type::from_integer(cmd);
 
@@ -66,9 +344,7 @@ static auto parse_r_type(command_size_t cmd) -> _Pair_t {
 
 #define match_and_return(a)                                                                        \
     case join(command::r_type::Funct7::a, command::r_type::Funct3::a):                             \
-        return {                                                                                   \
-            interpreter::ArithReg::fn<general::ArithOp::a>, arg                                    \
-        }
+        return make_arith_reg<general::ArithOp::a>(arg)
 
     switch (join(r_type.funct7, r_type.funct3)) {
         match_and_return(ADD);
@@ -105,8 +381,7 @@ static auto parse_i_type(command_size_t cmd) -> _Pair_t {
     auto arg    = Executable::MetaData{.rd = rd, .rs1 = rs1, .imm = i_type.get_imm()};
 
 #define match_and_return(a)                                                                        \
-    case command::i_type::Funct3::a: return { interpreter::ArithImm::fn<general::ArithOp::a>, arg  \
-        }
+    case command::i_type::Funct3::a: return make_arith_imm<general::ArithOp::a>(arg)
 
     switch (i_type.funct3) {
         match_and_return(ADD);
@@ -118,18 +393,18 @@ static auto parse_i_type(command_size_t cmd) -> _Pair_t {
 
         case command::i_type::Funct3::SLL:
             if (command::get_funct7(cmd) == command::i_type::Funct7::SLL) {
-                return {interpreter::ArithImm::fn<general::ArithOp::SLL>, arg};
+                return make_arith_imm<general::ArithOp::SLL>(arg);
             }
             break;
 
         case command::i_type::Funct3::SRL:
             if (command::get_funct7(cmd) == command::i_type::Funct7::SRL) {
-                return {interpreter::ArithImm::fn<general::ArithOp::SRL>, arg};
+                return make_arith_imm<general::ArithOp::SRL>(arg);
             }
             if (command::get_funct7(cmd) == command::i_type::Funct7::SRA) {
                 constexpr auto mask = sizeof(target_size_t) * 8 - 1;
                 arg.imm &= mask; // Mask the lower bits, to prevent undefined behavior.
-                return {interpreter::ArithImm::fn<general::ArithOp::SRA>, arg};
+                return make_arith_imm<general::ArithOp::SRA>(arg);
             }
             break; // Invalid shift operation.
 
@@ -141,15 +416,18 @@ static auto parse_i_type(command_size_t cmd) -> _Pair_t {
     handle_unknown_instruction(cmd);
 }
 
-static auto parse_s_type(command_size_t cmd) -> _Pair_t {
+static auto parse_s_type(command_size_t cmd, _Model_t model) -> _Pair_t {
     auto s_type = command::s_type::from_integer(cmd);
     auto rs1    = int_to_reg(s_type.rs1);
     auto rs2    = int_to_reg(s_type.rs2);
     auto arg    = Executable::MetaData{.rs1 = rs1, .rs2 = rs2, .imm = s_type.get_imm()};
 
 #define match_and_return(a)                                                                        \
-    case command::s_type::Funct3::a: return {                                                      \
-        interpreter::LoadStore::fn<general::MemoryOp::a>, arg                                      \
+    case command::s_type::Funct3::a:                                                               \
+        return {                                                                                   \
+            model.cache ? interpreter::LoadStore::fn<general::MemoryOp::a, true>                   \
+                        : interpreter::LoadStore::fn<general::MemoryOp::a, false>,                 \
+            arg                                                                                    \
         }
 
     switch (s_type.funct3) {
@@ -163,15 +441,18 @@ static auto parse_s_type(command_size_t cmd) -> _Pair_t {
     handle_unknown_instruction(cmd);
 }
 
-static auto parse_l_type(command_size_t cmd) -> _Pair_t {
+static auto parse_l_type(command_size_t cmd, _Model_t model) -> _Pair_t {
     auto l_type = command::l_type::from_integer(cmd);
     auto rs1    = int_to_reg(l_type.rs1);
     auto rd     = int_to_reg(l_type.rd);
     auto arg    = Executable::MetaData{.rd = rd, .rs1 = rs1, .imm = l_type.get_imm()};
 
 #define match_and_return(a)                                                                        \
-    case command::l_type::Funct3::a: return {                                                      \
-        interpreter::LoadStore::fn<general::MemoryOp::a>, arg                                      \
+    case command::l_type::Funct3::a:                                                               \
+        return {                                                                                   \
+            model.cache ? interpreter::LoadStore::fn<general::MemoryOp::a, true>                   \
+                        : interpreter::LoadStore::fn<general::MemoryOp::a, false>,                 \
+            arg                                                                                    \
         }
 
     switch (l_type.funct3) {
@@ -187,14 +468,18 @@ static auto parse_l_type(command_size_t cmd) -> _Pair_t {
     handle_unknown_instruction(cmd);
 }
 
-static auto parse_b_type(command_size_t cmd) -> _Pair_t {
+static auto parse_b_type(command_size_t cmd, _Model_t model) -> _Pair_t {
     auto b_type = command::b_type::from_integer(cmd);
     auto rs1    = int_to_reg(b_type.rs1);
     auto rs2    = int_to_reg(b_type.rs2);
     auto arg    = Executable::MetaData{.rs1 = rs1, .rs2 = rs2, .imm = b_type.get_imm()};
 
 #define match_and_return(a)                                                                        \
-    case command::b_type::Funct3::a: return { interpreter::Branch::fn<general::BranchOp::a>, arg   \
+    case command::b_type::Funct3::a:                                                               \
+        return {                                                                                   \
+            model.predictor ? interpreter::Branch::fn<general::BranchOp::a, true>                  \
+                            : interpreter::Branch::fn<general::BranchOp::a, false>,                \
+            arg                                                                                    \
         }
 
     switch (b_type.funct3) {
@@ -211,12 +496,13 @@ static auto parse_b_type(command_size_t cmd) -> _Pair_t {
     handle_unknown_instruction(cmd);
 }
 
-static auto parse_auipc(command_size_t cmd) -> _Pair_t {
+static auto parse_auipc(command_size_t cmd, target_size_t pc) -> _Pair_t {
     auto auipc = command::auipc::from_integer(cmd);
     auto rd    = int_to_reg(auipc.rd);
-    auto arg   = Executable::MetaData{.rd = rd, .imm = auipc.get_imm()};
+    // Each executable is bound to its own pc, so the result is a constant.
+    auto arg   = Executable::MetaData{.rd = rd, .imm = pc + auipc.get_imm()};
 
-    return {interpreter::Auipc::fn, arg};
+    return {interpreter::Lui::fn, arg};
 }
 
 static auto parse_lui(command_size_t cmd) -> _Pair_t {
@@ -227,38 +513,90 @@ static auto parse_lui(command_size_t cmd) -> _Pair_t {
     return {interpreter::Lui::fn, arg};
 }
 
-static auto parse_jal(command_size_t cmd) -> _Pair_t {
+static auto parse_jal(command_size_t cmd, _Model_t model) -> _Pair_t {
     auto jal = command::jal::from_integer(cmd);
     auto rd  = int_to_reg(jal.rd);
     auto arg = Executable::MetaData{.rd = rd, .imm = jal.get_imm()};
 
-    return {interpreter::Jump::fn, arg};
+    if (model.target)
+        return {interpreter::Jump::fn<true>, arg};
+    return {interpreter::Jump::fn<false>, arg};
 }
 
-static auto parse_jalr(command_size_t cmd) -> _Pair_t {
+static auto parse_jalr(command_size_t cmd, _Model_t model) -> _Pair_t {
     auto jalr = command::jalr::from_integer(cmd);
     auto rs1  = int_to_reg(jalr.rs1);
     auto rd   = int_to_reg(jalr.rd);
     auto arg  = Executable::MetaData{.rd = rd, .rs1 = rs1, .imm = jalr.get_imm()};
 
-    return {interpreter::Jalr::fn, arg};
+    if (model.target)
+        return {interpreter::Jalr::fn<true>, arg};
+    return {interpreter::Jalr::fn<false>, arg};
 }
 
-auto parse_cmd(command_size_t cmd) -> _Pair_t {
+auto parse_cmd(command_size_t cmd, target_size_t pc, _Model_t model) -> _Pair_t {
     switch (command::get_opcode(cmd)) {
         case command::r_type::opcode: return parse_r_type(cmd);
         case command::i_type::opcode: return parse_i_type(cmd);
-        case command::s_type::opcode: return parse_s_type(cmd);
-        case command::l_type::opcode: return parse_l_type(cmd);
-        case command::b_type::opcode: return parse_b_type(cmd);
-        case command::auipc::opcode:  return parse_auipc(cmd);
+        case command::s_type::opcode: return parse_s_type(cmd, model);
+        case command::l_type::opcode: return parse_l_type(cmd, model);
+        case command::b_type::opcode: return parse_b_type(cmd, model);
+        case command::auipc::opcode:  return parse_auipc(cmd, pc);
         case command::lui::opcode:    return parse_lui(cmd);
-        case command::jal::opcode:    return parse_jal(cmd);
-        case command::jalr::opcode:   return parse_jalr(cmd);
+        case command::jal::opcode:    return parse_jal(cmd, model);
+        case command::jalr::opcode:   return parse_jalr(cmd, model);
         default:                      break;
     }
 
     handle_unknown_instruction(cmd);
 }
 
+/* The counter of a given arithmetic operation. */
+static auto arith_counter(command_size_t funct3, bool is_extension) -> _Counter_t {
+    if (is_extension) { // M extension, see Arith_Funct3 in riscv/command.h
+        if (funct3 < command::r_type::Funct3::DIV)
+            return &Device::Counter::wMultiply;
+        return &Device::Counter::wDivide;
+    }
+    switch (funct3) {
+        case command::r_type::Funct3::ADD:  return &Device::Counter::wArith;
+        case command::r_type::Funct3::SLL:
+        case command::r_type::Funct3::SRL:  return &Device::Counter::wShift;
+        case command::r_type::Funct3::SLT:
+        case command::r_type::Funct3::SLTU: return &Device::Counter::wCompare;
+        default:                            return &Device::Counter::wBitwise;
+    }
+}
+
+/**
+ * The registers a command reads and writes, as if it were not fused.
+ * Only commands that have been parsed successfully may be asked.
+ */
+auto operands_of(command_size_t cmd) -> Executable::MetaData {
+    return parse_cmd(cmd, 0, {}).second;
+}
+
+/**
+ * Which counter a command adds one to, once executed.
+ * Only commands that have been parsed successfully may be counted,
+ * so no check is done here. Fused pairs are counted one by one.
+ */
+auto counter_of(command_size_t cmd) -> _Counter_t {
+    switch (command::get_opcode(cmd)) {
+        case command::r_type::opcode:
+            return arith_counter(
+                command::get_funct3(cmd), command::get_funct7(cmd) == command::r_type::Funct7::MUL
+            );
+        case command::i_type::opcode: return arith_counter(command::get_funct3(cmd), false);
+        case command::s_type::opcode: return &Device::Counter::wStore;
+        case command::l_type::opcode: return &Device::Counter::wLoad;
+        case command::b_type::opcode: return &Device::Counter::wBranch;
+        case command::auipc::opcode:
+        case command::lui::opcode:    return &Device::Counter::wUpper;
+        case command::jal::opcode:    return &Device::Counter::wJal;
+        case command::jalr::opcode:   return &Device::Counter::wJalr;
+        default:                      unreachable();
+    }
+}
+
 } // namespace dark
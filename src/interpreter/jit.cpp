@@ -0,0 +1,762 @@
+#if defined(REIMU_JIT)
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "The JIT tier only supports x86-64 Linux."
+#endif
+
+#include "simulation/jit.h"
+#include "declarations.h"
+#include "general.h"
+#include "interpreter/device.h"
+#include "interpreter/exception.h"
+#include "interpreter/interval.h"
+#include "interpreter/memory.h"
+#include "interpreter/register.h"
+#include "riscv/command.h"
+#include "riscv/register.h"
+#include "utility/error.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <sys/mman.h>
+#include <utility>
+#include <vector>
+
+namespace dark {
+
+namespace {
+
+struct NativeContext {
+    Memory *mem;
+    Device *dev;
+};
+
+/* Guest registers, context. Return the number of commands completed. */
+using Native_t = auto(target_size_t *, NativeContext *) -> std::uint32_t;
+
+/* A command that the native tier knows how to translate. */
+struct Command {
+    enum class Kind : std::uint8_t { ArithReg, ArithImm, Upper, Load, Store } kind;
+    std::uint8_t op; // general::ArithOp or general::MemoryOp
+    Register rd, rs1, rs2;
+    target_size_t imm;
+};
+
+static auto make_arith(Command::Kind kind, general::ArithOp op, Register rd, Register rs1)
+    -> Command {
+    return Command{
+        .kind    = kind,
+        .op      = static_cast<std::uint8_t>(op),
+        .rd      = rd,
+        .rs1     = rs1,
+        .rs2     = Register::zero,
+        .imm     = 0,
+    };
+}
+
+static auto decode_r_type(command_size_t cmd) -> std::optional<Command> {
+    auto r_type = command::r_type::from_integer(cmd);
+
+    constexpr auto join = // Same as the one in interpreter/executable.cpp
+        [](std::uint32_t a, std::uint32_t b) -> std::uint32_t { return (a << 3) | b; };
+
+    const auto rd  = int_to_reg(r_type.rd);
+    const auto rs1 = int_to_reg(r_type.rs1);
+
+#define match_and_return(a)                                                                        \
+    case join(command::r_type::Funct7::a, command::r_type::Funct3::a): {                           \
+        auto result = make_arith(Command::Kind::ArithReg, general::ArithOp::a, rd, rs1);           \
+        result.rs2  = int_to_reg(r_type.rs2);                                                      \
+        return result;                                                                             \
+    }
+
+    switch (join(r_type.funct7, r_type.funct3)) {
+        match_and_return(ADD);
+        match_and_return(SUB);
+        match_and_return(SLL);
+        match_and_return(SLT);
+        match_and_return(SLTU);
+        match_and_return(XOR);
+        match_and_return(SRL);
+        match_and_return(SRA);
+        match_and_return(OR);
+        match_and_return(AND);
+        match_and_return(MUL);
+        match_and_return(MULH);
+        match_and_return(MULHSU);
+        match_and_return(MULHU);
+        match_and_return(DIV);
+        match_and_return(DIVU);
+        match_and_return(REM);
+        match_and_return(REMU);
+        default: return std::nullopt;
+    }
+
+#undef match_and_return
+}
+
+static auto decode_i_type(command_size_t cmd) -> std::optional<Command> {
+    auto i_type = command::i_type::from_integer(cmd);
+
+    const auto rd  = int_to_reg(i_type.rd);
+    const auto rs1 = int_to_reg(i_type.rs1);
+    const auto imm = i_type.get_imm();
+
+    auto op = general::ArithOp{};
+    switch (i_type.funct3) {
+        using enum general::ArithOp;
+        case command::i_type::Funct3::ADD:  op = ADD; break;
+        case command::i_type::Funct3::SLT:  op = SLT; break;
+        case command::i_type::Funct3::SLTU: op = SLTU; break;
+        case command::i_type::Funct3::XOR:  op = XOR; break;
+        case command::i_type::Funct3::OR:   op = OR; break;
+        case command::i_type::Funct3::AND:  op = AND; break;
+        case command::i_type::Funct3::SLL:
+            if (command::get_funct7(cmd) != command::i_type::Funct7::SLL)
+                return std::nullopt;
+            op = SLL;
+            break;
+        case command::i_type::Funct3::SRL:
+            if (command::get_funct7(cmd) == command::i_type::Funct7::SRL)
+                op = SRL;
+            else if (command::get_funct7(cmd) == command::i_type::Funct7::SRA)
+                op = SRA;
+            else
+                return std::nullopt;
+            break;
+        default: return std::nullopt;
+    }
+
+    auto result = make_arith(Command::Kind::ArithImm, op, rd, rs1);
+    result.imm  = imm;
+    return result;
+}
+
+static auto decode_memory(command_size_t cmd) -> std::optional<Command> {
+    using enum general::MemoryOp;
+    if (command::get_opcode(cmd) == command::l_type::opcode) {
+        auto l_type = command::l_type::from_integer(cmd);
+        auto op     = general::MemoryOp{};
+        switch (l_type.funct3) {
+            case command::l_type::Funct3::LB:  op = LB; break;
+            case command::l_type::Funct3::LH:  op = LH; break;
+            case command::l_type::Funct3::LW:  op = LW; break;
+            case command::l_type::Funct3::LBU: op = LBU; break;
+            case command::l_type::Funct3::LHU: op = LHU; break;
+            default:                           return std::nullopt;
+        }
+        return Command{
+            .kind    = Command::Kind::Load,
+            .op      = static_cast<std::uint8_t>(op),
+            .rd      = int_to_reg(l_type.rd),
+            .rs1     = int_to_reg(l_type.rs1),
+            .rs2     = Register::zero,
+            .imm     = l_type.get_imm(),
+        };
+    } else {
+        auto s_type = command::s_type::from_integer(cmd);
+        auto op     = general::MemoryOp{};
+        switch (s_type.funct3) {
+            case command::s_type::Funct3::SB: op = SB; break;
+            case command::s_type::Funct3::SH: op = SH; break;
+            case command::s_type::Funct3::SW: op = SW; break;
+            default:                          return std::nullopt;
+        }
+        return Command{
+            .kind    = Command::Kind::Store,
+            .op      = static_cast<std::uint8_t>(op),
+            .rd      = Register::zero,
+            .rs1     = int_to_reg(s_type.rs1),
+            .rs2     = int_to_reg(s_type.rs2),
+            .imm     = s_type.get_imm(),
+        };
+    }
+}
+
+/**
+ * Decode a command for the native tier.
+ * Return nothing if the command must be executed by the interpreter,
+ * which includes all control flow and unknown commands.
+ */
+static auto decode(command_size_t cmd, target_size_t pc) -> std::optional<Command> {
+    const auto upper = [](Register rd, target_size_t imm) {
+        return Command{
+            .kind    = Command::Kind::Upper,
+            .op      = 0,
+            .rd      = rd,
+            .rs1     = Register::zero,
+            .rs2     = Register::zero,
+            .imm     = imm,
+        };
+    };
+
+    switch (command::get_opcode(cmd)) {
+        case command::r_type::opcode: return decode_r_type(cmd);
+        case command::i_type::opcode: return decode_i_type(cmd);
+        case command::l_type::opcode:
+        case command::s_type::opcode: return decode_memory(cmd);
+        case command::lui::opcode: {
+            auto lui = command::lui::from_integer(cmd);
+            return upper(int_to_reg(lui.rd), lui.get_imm());
+        }
+        case command::auipc::opcode: {
+            auto auipc = command::auipc::from_integer(cmd);
+            return upper(int_to_reg(auipc.rd), pc + auipc.get_imm());
+        }
+        default: return std::nullopt;
+    }
+}
+
+/**
+ * Memory accesses are forwarded to the interpreter's memory and device,
+ * so that all checks and the cache simulation stay exactly the same.
+ * Errors are not propagated through native frames. Instead, the native
+ * code returns early, and the interpreter re-executes the command.
+ */
+template <general::MemoryOp op>
+static auto native_load(NativeContext *ctx, target_size_t addr) noexcept -> std::int64_t {
+    using enum general::MemoryOp;
+    try {
+        auto &mem = *ctx->mem;
+        auto &dev = *ctx->dev;
+        auto value = target_size_t{};
+        switch (op) {
+            case LB:  value = mem.load_i8(addr), dev.try_load(addr, 1); break;
+            case LH:  value = mem.load_i16(addr), dev.try_load(addr, 2); break;
+            case LW:  value = mem.load_i32(addr), dev.try_load(addr, 4); break;
+            case LBU: value = mem.load_u8(addr), dev.try_load(addr, 1); break;
+            case LHU: value = mem.load_u16(addr), dev.try_load(addr, 2); break;
+            default:  unreachable();
+        }
+        return value;
+    } catch (FailToInterpret &) { return -1; }
+}
+
+template <general::MemoryOp op>
+static auto native_store(NativeContext *ctx, target_size_t addr, target_size_t value) noexcept
+    -> std::int32_t {
+    using enum general::MemoryOp;
+    try {
+        auto &mem = *ctx->mem;
+        auto &dev = *ctx->dev;
+        switch (op) {
+            case SB: mem.store_u8(addr, value), dev.try_store(addr, 1); break;
+            case SH: mem.store_u16(addr, value), dev.try_store(addr, 2); break;
+            case SW: mem.store_u32(addr, value), dev.try_store(addr, 4); break;
+            default: unreachable();
+        }
+        return 0;
+    } catch (FailToInterpret &) { return -1; }
+}
+
+static auto get_load_helper(general::MemoryOp op) -> void * {
+    using enum general::MemoryOp;
+    switch (op) {
+        case LB:  return reinterpret_cast<void *>(native_load<LB>);
+        case LH:  return reinterpret_cast<void *>(native_load<LH>);
+        case LW:  return reinterpret_cast<void *>(native_load<LW>);
+        case LBU: return reinterpret_cast<void *>(native_load<LBU>);
+        case LHU: return reinterpret_cast<void *>(native_load<LHU>);
+        default:  unreachable();
+    }
+}
+
+static auto get_store_helper(general::MemoryOp op) -> void * {
+    using enum general::MemoryOp;
+    switch (op) {
+        case SB: return reinterpret_cast<void *>(native_store<SB>);
+        case SH: return reinterpret_cast<void *>(native_store<SH>);
+        case SW: return reinterpret_cast<void *>(native_store<SW>);
+        default: unreachable();
+    }
+}
+
+// x86-64 general purpose registers, in encoding order.
+enum Host : std::uint8_t {
+    rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+    r8,  r9,  r10, r11, r12, r13, r14, r15,
+};
+
+// Callee-saved registers which hold the most used guest registers.
+static constexpr Host kHomes[] = {rbx, r12, r13, r14, r15};
+
+/**
+ * A tiny x86-64 emitter, which only supports what the translator needs.
+ *
+ * Register usage:
+ * - rbp: base of the guest register file.
+ * - rbx, r12 ~ r15: homes of some guest registers.
+ * - rax, rcx, rdx, rsi, rdi: scratch, also used to call the helpers.
+ * - [rsp]: the native context.
+ */
+struct Emitter {
+public:
+    std::vector<std::uint8_t> code;
+
+    void byte(std::uint8_t x) { code.push_back(x); }
+    void bytes(std::initializer_list<std::uint8_t> list) { code.insert(code.end(), list); }
+    void dword(std::uint32_t x) {
+        for (int i = 0; i < 4; ++i)
+            byte(static_cast<std::uint8_t>(x >> (i * 8)));
+    }
+    void qword(std::uint64_t x) {
+        dword(static_cast<std::uint32_t>(x));
+        dword(static_cast<std::uint32_t>(x >> 32));
+    }
+
+    void rex(bool w, Host reg, Host rm) {
+        const auto prefix = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+        if (prefix != 0x40)
+            byte(static_cast<std::uint8_t>(prefix));
+    }
+    void modrm(std::uint8_t mod, std::uint8_t reg, std::uint8_t rm) {
+        byte(static_cast<std::uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7)));
+    }
+
+    /* op r/m, reg (register direct). */
+    void op_rr(std::uint8_t op, Host reg, Host rm, bool w = false) {
+        rex(w, reg, rm);
+        byte(op);
+        modrm(3, reg, rm);
+    }
+    /* op reg, [rbp + disp8]. */
+    void op_rbp(std::uint8_t op, Host reg, std::uint8_t disp) {
+        rex(false, reg, rbp);
+        byte(op);
+        modrm(1, reg, rbp);
+        byte(disp);
+    }
+    /* group1 r/m32, imm32. */
+    void alu_ri(std::uint8_t digit, Host rm, std::uint32_t imm) {
+        rex(false, rax, rm);
+        byte(0x81);
+        modrm(3, digit, rm);
+        dword(imm);
+    }
+    void mov_ri(Host reg, std::uint32_t imm) {
+        rex(false, rax, reg);
+        byte(static_cast<std::uint8_t>(0xB8 + (reg & 7)));
+        dword(imm);
+    }
+    void push(Host reg) {
+        rex(false, rax, reg);
+        byte(static_cast<std::uint8_t>(0x50 + (reg & 7)));
+    }
+    void pop(Host reg) {
+        rex(false, rax, reg);
+        byte(static_cast<std::uint8_t>(0x58 + (reg & 7)));
+    }
+    /* Emit a jcc/jmp with rel32, return the position to patch. */
+    auto jump(std::initializer_list<std::uint8_t> op) -> std::size_t {
+        bytes(op);
+        dword(0);
+        return code.size() - 4;
+    }
+    void patch(std::size_t where, std::size_t target) {
+        const auto rel = static_cast<std::uint32_t>(target - (where + 4));
+        std::memcpy(code.data() + where, &rel, sizeof(rel));
+    }
+};
+
+struct Translator : Emitter {
+public:
+    explicit Translator(std::span<const Command> cmds) : cmds(cmds) {
+        this->home.fill(-1);
+        std::array<std::size_t, 32> usage{};
+        for (auto &cmd : cmds) {
+            usage[reg_to_int(cmd.rd)] += 1;
+            usage[reg_to_int(cmd.rs1)] += 1;
+            usage[reg_to_int(cmd.rs2)] += 1;
+        }
+        usage[0] = 0; // zero is never cached
+
+        std::array<std::uint8_t, 32> order;
+        for (std::size_t i = 0; i < order.size(); ++i)
+            order[i] = static_cast<std::uint8_t>(i);
+        std::ranges::stable_sort(order, std::greater{}, [&](std::uint8_t i) { return usage[i]; });
+
+        for (std::size_t i = 0; i < std::size(kHomes); ++i) {
+            if (usage[order[i]] == 0)
+                break;
+            this->home[order[i]] = static_cast<std::int8_t>(kHomes[i]);
+            this->homed.push_back(order[i]);
+        }
+    }
+
+    auto translate() -> std::vector<std::uint8_t> {
+        this->prologue();
+        for (std::size_t i = 0; i < cmds.size(); ++i)
+            this->emit(cmds[i], static_cast<std::uint32_t>(i));
+        this->mov_ri(rax, static_cast<std::uint32_t>(cmds.size()));
+        this->epilogue();
+        return std::move(this->code);
+    }
+
+private:
+    std::span<const Command> cmds;
+    std::array<std::int8_t, 32> home;
+    std::vector<std::uint8_t> homed;
+    std::vector<std::pair<std::size_t, std::uint32_t>> faults;
+
+    static auto offset(std::uint8_t reg) -> std::uint8_t {
+        return static_cast<std::uint8_t>(reg * sizeof(target_size_t));
+    }
+
+    /* Read a guest register into a host register. */
+    void read(Host dst, Register src) {
+        const auto g = reg_to_int(src);
+        if (g == 0)
+            return this->op_rr(0x31, dst, dst); // xor dst, dst
+        if (this->home[g] >= 0) {
+            if (this->home[g] != dst)
+                this->op_rr(0x89, static_cast<Host>(this->home[g]), dst);
+            return;
+        }
+        this->op_rbp(0x8B, dst, offset(g));
+    }
+
+    /* Write a host register into a guest register. Writes to zero are dropped. */
+    void write(Register dst, Host src) {
+        const auto g = reg_to_int(dst);
+        if (g == 0)
+            return;
+        if (this->home[g] >= 0)
+            return this->op_rr(0x89, src, static_cast<Host>(this->home[g]));
+        this->op_rbp(0x89, src, offset(g));
+    }
+
+    void prologue() {
+        this->push(rbx);
+        this->push(rbp);
+        this->push(r12);
+        this->push(r13);
+        this->push(r14);
+        this->push(r15);
+        this->bytes({0x48, 0x83, 0xEC, 0x08}); // sub rsp, 8
+        this->bytes({0x48, 0x89, 0x34, 0x24}); // mov [rsp], rsi
+        this->bytes({0x48, 0x89, 0xFD});       // mov rbp, rdi
+        for (auto g : this->homed)
+            this->op_rbp(0x8B, static_cast<Host>(this->home[g]), offset(g));
+    }
+
+    /* Write back all homes and return eax. Fault stubs are placed after it. */
+    void epilogue() {
+        const auto exit = this->code.size();
+        for (auto g : this->homed)
+            this->op_rbp(0x89, static_cast<Host>(this->home[g]), offset(g));
+        this->bytes({0x48, 0x83, 0xC4, 0x08}); // add rsp, 8
+        this->pop(r15);
+        this->pop(r14);
+        this->pop(r13);
+        this->pop(r12);
+        this->pop(rbp);
+        this->pop(rbx);
+        this->byte(0xC3); // ret
+
+        for (auto [where, index] : this->faults) {
+            this->patch(where, this->code.size());
+            this->mov_ri(rax, index);
+            this->patch(this->jump({0xE9}), exit);
+        }
+    }
+
+    void set_flag(std::uint8_t cc) {
+        this->bytes({0x0F, cc, 0xC0});   // setcc al
+        this->bytes({0x0F, 0xB6, 0xC0}); // movzx eax, al
+    }
+
+    /* The upper half of the 64-bit product of rax and rcx. */
+    void mul_high() {
+        this->bytes({0x48, 0x0F, 0xAF, 0xC1}); // imul rax, rcx
+        this->bytes({0x48, 0xC1, 0xE8, 0x20}); // shr rax, 32
+    }
+
+    void emit(const Command &cmd, std::uint32_t index) {
+        switch (cmd.kind) {
+            case Command::Kind::ArithReg: return this->emit_arith_reg(cmd, index);
+            case Command::Kind::ArithImm: return this->emit_arith_imm(cmd);
+            case Command::Kind::Upper:
+                if (cmd.rd == Register::zero)
+                    return;
+                this->mov_ri(rax, cmd.imm);
+                return this->write(cmd.rd, rax);
+            case Command::Kind::Load:  return this->emit_load(cmd, index);
+            case Command::Kind::Store: return this->emit_store(cmd, index);
+            default:                   unreachable();
+        }
+    }
+
+    /**
+     * Division by zero, as well as the signed overflow case, is left to the
+     * interpreter, which either reports the error or behaves as it always does.
+     */
+    void emit_divide(const Command &cmd, std::uint32_t index) {
+        using enum general::ArithOp;
+        const auto op     = static_cast<general::ArithOp>(cmd.op);
+        const bool is_signed = (op == DIV || op == REM);
+
+        this->read(rax, cmd.rs1);
+        this->read(rcx, cmd.rs2);
+        this->bytes({0x85, 0xC9}); // test ecx, ecx
+        this->faults.emplace_back(this->jump({0x0F, 0x84}), index); // jz fault
+        if (is_signed) {
+            this->bytes({0x83, 0xF9, 0xFF}); // cmp ecx, -1
+            this->faults.emplace_back(this->jump({0x0F, 0x84}), index); // je fault
+            this->bytes({0x99, 0xF7, 0xF9}); // cdq; idiv ecx
+        } else {
+            this->bytes({0x31, 0xD2, 0xF7, 0xF1}); // xor edx, edx; div ecx
+        }
+        this->write(cmd.rd, (op == DIV || op == DIVU) ? rax : rdx);
+    }
+
+    void emit_arith_reg(const Command &cmd, std::uint32_t index) {
+        using enum general::ArithOp;
+        const auto op = static_cast<general::ArithOp>(cmd.op);
+        if (op == DIV || op == DIVU || op == REM || op == REMU)
+            return this->emit_divide(cmd, index); // rd == zero may still throw
+        if (cmd.rd == Register::zero)
+            return; // No side effect at all.
+
+        this->read(rax, cmd.rs1);
+        this->read(rcx, cmd.rs2);
+
+        switch (op) {
+            case ADD: this->op_rr(0x01, rcx, rax); break;
+            case SUB: this->op_rr(0x29, rcx, rax); break;
+            case AND: this->op_rr(0x21, rcx, rax); break;
+            case OR:  this->op_rr(0x09, rcx, rax); break;
+            case XOR: this->op_rr(0x31, rcx, rax); break;
+            // x86 masks the shift count by 31, just as RISC-V does.
+            case SLL: this->bytes({0xD3, 0xE0}); break; // shl eax, cl
+            case SRL: this->bytes({0xD3, 0xE8}); break; // shr eax, cl
+            case SRA: this->bytes({0xD3, 0xF8}); break; // sar eax, cl
+            case SLT:
+                this->op_rr(0x39, rcx, rax);
+                this->set_flag(0x9C); // setl
+                break;
+            case SLTU:
+                this->op_rr(0x39, rcx, rax);
+                this->set_flag(0x92); // setb
+                break;
+            case MUL: this->bytes({0x0F, 0xAF, 0xC1}); break; // imul eax, ecx
+            case MULH:
+                this->bytes({0x48, 0x63, 0xC0}); // movsxd rax, eax
+                this->bytes({0x48, 0x63, 0xC9}); // movsxd rcx, ecx
+                this->mul_high();
+                break;
+            case MULHSU:
+                this->bytes({0x48, 0x63, 0xC0}); // movsxd rax, eax
+                this->mul_high();
+                break;
+            case MULHU: this->mul_high(); break; // Both are zero-extended already.
+            default: unreachable();
+        }
+
+        this->write(cmd.rd, rax);
+    }
+
+    void emit_arith_imm(const Command &cmd) {
+        if (cmd.rd == Register::zero)
+            return; // No side effect at all.
+
+        this->read(rax, cmd.rs1);
+
+        using enum general::ArithOp;
+        switch (static_cast<general::ArithOp>(cmd.op)) {
+            case ADD: this->alu_ri(0, rax, cmd.imm); break;
+            case OR:  this->alu_ri(1, rax, cmd.imm); break;
+            case AND: this->alu_ri(4, rax, cmd.imm); break;
+            case XOR: this->alu_ri(6, rax, cmd.imm); break;
+            case SLL: this->bytes({0xC1, 0xE0, std::uint8_t(cmd.imm & 31)}); break;
+            case SRL: this->bytes({0xC1, 0xE8, std::uint8_t(cmd.imm & 31)}); break;
+            case SRA: this->bytes({0xC1, 0xF8, std::uint8_t(cmd.imm & 31)}); break;
+            case SLT:
+                this->alu_ri(7, rax, cmd.imm);
+                this->set_flag(0x9C); // setl
+                break;
+            case SLTU:
+                this->alu_ri(7, rax, cmd.imm);
+                this->set_flag(0x92); // setb
+                break;
+            default: unreachable();
+        }
+
+        this->write(cmd.rd, rax);
+    }
+
+    /* esi = rs1 + imm, rdi = context */
+    void emit_address(const Command &cmd) {
+        this->read(rsi, cmd.rs1);
+        if (cmd.imm != 0)
+            this->alu_ri(0, rsi, cmd.imm);
+        this->bytes({0x48, 0x8B, 0x3C, 0x24}); // mov rdi, [rsp]
+    }
+
+    void emit_call(void *helper) {
+        this->bytes({0x48, 0xB8}); // mov rax, imm64
+        this->qword(reinterpret_cast<std::uintptr_t>(helper));
+        this->bytes({0xFF, 0xD0}); // call rax
+    }
+
+    void emit_load(const Command &cmd, std::uint32_t index) {
+        this->emit_address(cmd);
+        this->emit_call(get_load_helper(static_cast<general::MemoryOp>(cmd.op)));
+        this->bytes({0x48, 0x85, 0xC0}); // test rax, rax
+        this->faults.emplace_back(this->jump({0x0F, 0x88}), index); // js fault
+        this->write(cmd.rd, rax);
+    }
+
+    void emit_store(const Command &cmd, std::uint32_t index) {
+        this->emit_address(cmd);
+        this->read(rdx, cmd.rs2);
+        this->emit_call(get_store_helper(static_cast<general::MemoryOp>(cmd.op)));
+        this->bytes({0x85, 0xC0}); // test eax, eax
+        this->faults.emplace_back(this->jump({0x0F, 0x85}), index); // jnz fault
+    }
+};
+
+/* A W^X region holding all the translated code. */
+struct CodeArena {
+public:
+    static constexpr std::size_t kSize = std::size_t{16} << 20;
+
+    CodeArena() {
+        constexpr auto kProt = PROT_READ | PROT_EXEC;
+        auto *ptr = ::mmap(nullptr, kSize, kProt, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        this->base = ptr == MAP_FAILED ? nullptr : static_cast<std::uint8_t *>(ptr);
+    }
+    CodeArena(const CodeArena &)            = delete;
+    CodeArena &operator=(const CodeArena &) = delete;
+    ~CodeArena() {
+        if (this->base)
+            ::munmap(this->base, kSize);
+    }
+
+    /* Copy the code into the arena. Return nullptr if there is no space left. */
+    auto install(std::span<const std::uint8_t> code) -> Native_t * {
+        constexpr std::size_t kAlign = 16;
+        if (this->base == nullptr || this->used + code.size() > kSize)
+            return nullptr;
+        if (::mprotect(this->base, kSize, PROT_READ | PROT_WRITE) != 0)
+            return nullptr;
+        auto *where = this->base + this->used;
+        std::memcpy(where, code.data(), code.size());
+        runtime_assert(::mprotect(this->base, kSize, PROT_READ | PROT_EXEC) == 0);
+        this->used += (code.size() + kAlign - 1) / kAlign * kAlign;
+        return reinterpret_cast<Native_t *>(where);
+    }
+
+private:
+    std::uint8_t *base{};
+    std::size_t used{};
+};
+
+} // namespace
+
+struct JitTier::Impl {
+public:
+    // A block must be executed so many times before being translated.
+    static constexpr std::uint32_t kHotThreshold = 64;
+    // Longer blocks are translated partially.
+    static constexpr std::size_t kMaxLength = 512;
+    // Memory accesses go through helper calls, which are no faster than the
+    // interpreter. A prefix without enough register-only work is not worth it.
+    static constexpr std::size_t kMinCompute = 4;
+
+    // Counters are not touched here, the whole block is counted by the caller.
+    struct Block {
+        Native_t *code;
+        std::size_t length;
+    };
+
+    static constexpr std::int32_t kCold   = -1;
+    static constexpr std::int32_t kFailed = -2;
+
+    struct Slot {
+        std::uint32_t heat  = 0;
+        std::int32_t  index = kCold;
+    };
+
+    Interval text;
+    std::vector<Slot> slots;
+    std::vector<Block> blocks;
+    CodeArena arena;
+
+    explicit Impl(Memory &mem) : text(mem.get_text_range()) {
+        const auto size = (text.finish - kTextStart) / sizeof(command_size_t);
+        this->slots.resize(size);
+    }
+
+    auto compile(target_size_t pc, Memory &mem) -> std::int32_t {
+        std::vector<Command> cmds;
+        while (cmds.size() < kMaxLength && pc < this->text.finish) {
+            auto cmd = decode(mem.load_cmd(pc), pc);
+            if (!cmd.has_value())
+                break;
+            cmds.push_back(*cmd);
+            pc += sizeof(command_size_t);
+        }
+
+        const auto compute = std::ranges::count_if(cmds, [](const Command &cmd) {
+            return cmd.kind != Command::Kind::Load && cmd.kind != Command::Kind::Store;
+        });
+        if (std::size_t(compute) < kMinCompute)
+            return kFailed;
+
+        auto code   = Translator{cmds}.translate();
+        auto native = this->arena.install(code);
+        if (native == nullptr)
+            return kFailed;
+
+        this->blocks.push_back({.code = native, .length = cmds.size()});
+        return static_cast<std::int32_t>(this->blocks.size() - 1);
+    }
+};
+
+JitTier::JitTier(Memory &mem) : impl(std::make_unique<Impl>(mem)) {}
+
+JitTier::~JitTier() = default;
+
+/**
+ * Try to run the straight-line prefix of the block at current pc natively.
+ * Count is the number of commands that the interpreter is about to run.
+ *
+ * At least one command is always left to the interpreter, so that control
+ * flow, timeout and error reporting are all handled in a single place.
+ * On a memory fault, the faulting command is left to the interpreter as
+ * well, which will report the error just as if there is no native tier.
+ */
+auto JitTier::run(RegisterFile &rf, Memory &mem, Device &dev, std::size_t count) -> std::size_t {
+    auto &impl = *this->impl;
+    if (count <= Impl::kMinCompute)
+        return 0;
+
+    const auto which = (rf.get_pc() - kTextStart) / sizeof(command_size_t);
+    if (which >= impl.slots.size())
+        return 0;
+
+    auto &slot = impl.slots[which];
+    if (slot.index < 0) {
+        if (slot.index == Impl::kFailed || ++slot.heat < Impl::kHotThreshold)
+            return 0;
+        slot.index = impl.compile(rf.get_pc(), mem);
+        if (slot.index < 0)
+            return 0;
+    }
+
+    const auto &block = impl.blocks[slot.index];
+    if (block.length >= count)
+        return 0;
+
+    NativeContext ctx{.mem = &mem, .dev = &dev};
+    return block.code(&rf[Register::zero], &ctx);
+}
+
+} // namespace dark
+
+#endif // REIMU_JIT
@@ -2,12 +2,18 @@
 #include "declarations.h"
 #include "interpreter/exception.h"
 #include "simulation/area.h"
-#include "utility/misc.h"
+#include "utility/error.h"
+#include <array>
 #include <cstddef>
+#include <cstring>
 #include <memory>
+#include <optional>
+#include <vector>
 
 namespace dark {
 
+using console::profile;
+
 using i8  = std::int8_t;
 using i16 = std::int16_t;
 using i32 = std::int32_t;
@@ -21,14 +27,112 @@ static auto int_cast(std::byte *ptr) -> _Int & {
 }
 
 /**
- * Real Memory layout:
+ * Real Memory layout, all in one host mapping:
  * - Libc text
  * - Text
  * - Data | RoData | Bss | Heap
+ * - Stack
  */
-struct Memory_Impl : StaticArea, HeapArea, StackArea {
-    explicit Memory_Impl(const Config &config, const MemoryLayout &layout) :
-        StaticArea(layout, config), HeapArea(layout, config), StackArea(layout, config) {}
+struct Memory_Impl : GuestSpace, StaticArea, HeapArea, StackArea {
+    explicit Memory_Impl(
+        const Config &config, const MemoryLayout &layout, const StaticImage &image
+    ) :
+        GuestSpace(layout, config), StaticArea(layout, config, *this, image),
+        HeapArea(layout, config, *this), StackArea(layout, config, *this) {
+        this->tlb.fill(kInvalid);
+    }
+
+    /**
+     * A direct-mapped cache from a guest page to the end of the area it
+     * lies in. A hit answers both whether an access is in bound and how
+     * much is left for a libc call, in one check. Any change of the heap
+     * flushes it, so it never covers anything out of bound.
+     */
+    struct TlbEntry {
+        target_size_t base; // Address of the page
+        target_size_t finish;
+    };
+    static constexpr std::size_t kTlbSize  = 64;
+    static constexpr int kPageBits         = 12;
+    static constexpr target_size_t kOffset = (1 << kPageBits) - 1;
+    static constexpr TlbEntry kInvalid     = {.base = 1, .finish = 0}; // Never a page address
+    std::array<TlbEntry, kTlbSize> tlb;
+
+    /**
+     * Whether a load or store of _Int hits the cache. The low bits of the
+     * address are kept in the tag, so a misaligned one never hits, and the
+     * alignment check is only done on a miss.
+     */
+    template <std::integral _Int>
+    bool hit(target_size_t addr) const {
+        constexpr auto kMask = ~kOffset | (sizeof(_Int) - 1);
+        const auto &entry    = this->tlb[(addr >> kPageBits) % kTlbSize];
+        return (addr & kMask) == entry.base && std::size_t{addr} + sizeof(_Int) <= entry.finish;
+    }
+
+    auto find_area(target_size_t lo, target_size_t hi) const -> std::optional<Interval> {
+        if (auto data = this->get_data_range(); data.contains(lo, hi))
+            return data;
+        if (auto heap = HeapArea::get_range(); heap.contains(lo, hi))
+            return heap;
+        if (auto stack = StackArea::get_range(); stack.contains(lo, hi))
+            return stack;
+        return std::nullopt;
+    }
+
+    /* The end of the area holding [lo, hi), or 0 if there is none. */
+    auto translate(target_size_t lo, target_size_t hi) -> target_size_t {
+        const auto base = lo & ~kOffset;
+        auto &entry     = this->tlb[(lo >> kPageBits) % kTlbSize];
+        if (entry.base == base && hi <= entry.finish) [[likely]]
+            return entry.finish;
+        const auto area = this->find_area(lo, hi);
+        if (!area.has_value())
+            return 0;
+        // A page shared with something else below, e.g. the text, is never cached.
+        if (area->start <= base)
+            entry = {.base = base, .finish = area->finish};
+        return area->finish;
+    }
+
+    bool accessible(target_size_t lo, target_size_t hi) { return this->translate(lo, hi) != 0; }
+
+    /* The host pointer to [addr, addr + size), which may span areas next to each other. */
+    auto get_bulk(target_size_t addr, target_size_t size) -> char * {
+        if (size > target_size_t(-1) - addr)
+            return nullptr;
+        for (auto lo = addr, hi = addr + size; lo < hi;) {
+            lo = this->translate(lo, lo + 1);
+            if (lo == 0)
+                return nullptr;
+        }
+        return std::bit_cast<char *>(this->get_host(addr));
+    }
+
+    auto grow(target_ssize_t size) -> std::pair<char *, target_size_t> {
+        this->tlb.fill(kInvalid);
+        return HeapArea::grow(size);
+    }
+
+    /* Devices mapped by map_device, only looked up when out of all the areas. */
+    struct MappedRange {
+        Interval range;
+        Memory::Mapped *device;
+    };
+    std::vector<MappedRange> mapped;
+
+    auto find_mapped(target_size_t lo, target_size_t hi) const -> const MappedRange * {
+        for (const auto &entry : this->mapped)
+            if (entry.range.contains(lo, hi))
+                return &entry;
+        return nullptr;
+    }
+
+    template <std::integral _Int>
+    auto outside_load(target_size_t) -> _Int;
+
+    template <std::unsigned_integral _Int>
+    void outside_store(target_size_t, _Int);
 
     auto checked_ifetch(target_size_t) -> command_size_t;
 
@@ -41,9 +145,13 @@ struct Memory_Impl : StaticArea, HeapArea, StackArea {
     auto get_segment(target_size_t) -> std::span<char>;
 };
 
+struct Memory::Image : StaticImage {
+    using StaticImage::StaticImage;
+};
+
 struct Memory::Impl : Memory, Memory_Impl {
-    explicit Impl(const Config &config, const MemoryLayout &layout) :
-        Memory(), Memory_Impl(config, layout) {}
+    explicit Impl(const Config &config, const MemoryLayout &layout, const Image &image) :
+        Memory(), Memory_Impl(config, layout, image) {}
 };
 
 auto Memory::get_impl() -> Impl & {
@@ -90,15 +198,23 @@ void Memory::store_u32(target_size_t addr, u32 value) {
     this->get_impl().check_store(addr, value);
 }
 
-auto Memory::create(const Config &config, const MemoryLayout &result) -> unique_t {
-    auto retval = std::make_unique<Impl>(config, result);
+auto Memory::snapshot(const MemoryLayout &layout) -> std::shared_ptr<const Image> {
+    return std::make_shared<const Image>(layout);
+}
+
+auto Memory::create(const Config &config, const MemoryLayout &result, const Image &image)
+    -> unique_t {
+    auto retval = std::make_unique<Impl>(config, result, image);
     auto *ptr   = retval.get();
 
     auto [static_low, static_top] = static_cast<StaticArea *>(ptr)->get_range();
     auto [heap_low, heap_top]     = static_cast<HeapArea *>(ptr)->get_range();
     auto [stack_low, stack_top]   = static_cast<StackArea *>(ptr)->get_range();
 
-    if (static_top > heap_low || heap_top > stack_low)
+    // At least a page of heap for malloc to start with, and then the guard band.
+    const auto heap_limit = std::size_t{GuestSpace::page_up(heap_top + 1)} + kGuardSize;
+
+    if (static_top > heap_low || heap_limit > stack_low)
         panic(
             "Not enough memory for the program!\n"
             "  Hint: In RISC-V, the lowest {0} bytes are reserved.\n"
@@ -111,7 +227,7 @@ auto Memory::create(const Config &config, const MemoryLayout &result) -> unique_
             "        Current memory size: {7}\n"
             "        Minimum memory size: {8}\n",
             kTextStart, static_low, static_top, static_top - static_low, stack_low, stack_top,
-            stack_top - stack_low, stack_top, heap_top + stack_top - stack_low
+            stack_top - stack_low, stack_top, heap_limit + stack_top - stack_low
         );
 
     return retval;
@@ -121,6 +237,17 @@ auto Memory::sbrk(target_ssize_t inc) -> std::pair<char *, target_size_t> {
     return this->get_impl().grow(inc);
 }
 
+void Memory::map_device(target_size_t addr, target_size_t size, Mapped &device) {
+    auto &impl       = this->get_impl();
+    const auto range = Interval{addr, addr + size};
+    runtime_assert(size != 0 && range.start < range.finish);
+    // Never over the normal memory (including libc), nor any other device.
+    runtime_assert(range.finish <= kTextStart || range.start >= this->get_stack_end());
+    for (const auto &[other, _] : impl.mapped)
+        runtime_assert(range.finish <= other.start || other.finish <= range.start);
+    impl.mapped.push_back({range, &device});
+}
+
 auto Memory::get_text_range() -> Interval {
     return static_cast<StaticArea &>(this->get_impl()).get_text_range();
 }
@@ -129,8 +256,64 @@ auto Memory::libc_access(target_size_t addr) -> std::span<char> {
     return this->get_impl().get_segment(addr);
 }
 
+auto Memory::read_range(target_size_t addr, target_size_t size) -> const char * {
+    return this->get_impl().get_bulk(addr, size);
+}
+
+auto Memory::write_range(target_size_t addr, target_size_t size) -> char * {
+    return this->get_impl().get_bulk(addr, size);
+}
+
+bool Memory::copy_range(target_size_t dst, target_size_t src, target_size_t size) {
+    auto &impl = this->get_impl();
+    auto *to   = impl.get_bulk(dst, size);
+    auto *from = impl.get_bulk(src, size);
+    if (to == nullptr || from == nullptr)
+        return false;
+    std::memmove(to, from, size);
+    return true;
+}
+
+/**
+ * Usage of the guest memory, by the pages the host has given to it.
+ * Pages are never given back, except when the heap shrinks, which the
+ * built-in malloc never does, so the pages present at exit are the peak.
+ */
 void Memory::print_details(bool detail) const {
-    allow_unused(detail);
+    if (!detail)
+        return;
+
+    const auto &impl = static_cast<const Impl &>(*this);
+
+    const auto [static_low, static_top] = static_cast<const StaticArea &>(impl).get_range();
+    const auto heap_low                 = static_cast<const HeapArea &>(impl).get_range().start;
+    const auto heap_peak                = static_cast<const HeapArea &>(impl).get_peak();
+    const auto [stack_low, stack_top]   = static_cast<const StackArea &>(impl).get_range();
+
+    const auto static_usage = impl.scan(static_low, static_top);
+    const auto heap_usage   = impl.scan(heap_low, heap_peak);
+    const auto stack_usage  = impl.scan(stack_low, stack_top);
+
+    if (!static_usage || !heap_usage || !stack_usage) {
+        profile << "Memory usage: unavailable\n";
+        return;
+    }
+
+    constexpr auto kib = [](target_size_t pages) { return pages * 4; };
+    const auto depth   = stack_top - std::min(stack_usage->lowest, stack_top);
+    const auto total   = static_usage->touched + heap_usage->touched + stack_usage->touched;
+
+    profile << fmt::format(
+        "Memory usage:\n"
+        "# resident = {} KiB\n"
+        "# static   = {} KiB touched, {} KiB dirty\n"
+        "# heap     = {} KiB touched, {} KiB dirty, high-water mark {} bytes\n"
+        "# stack    = {} KiB touched, {} KiB dirty, max depth {} bytes\n",
+        kib(total),                                                             // resident
+        kib(static_usage->touched), kib(static_usage->dirty),                   // static
+        kib(heap_usage->touched), kib(heap_usage->dirty), heap_peak - heap_low, // heap
+        kib(stack_usage->touched), kib(stack_usage->dirty), depth               // stack
+    );
 }
 
 auto Memory::get_heap_start() const -> target_size_t {
@@ -164,49 +347,119 @@ auto Memory_Impl::checked_ifetch(target_size_t pc) -> command_size_t {
     if (!this->in_text(pc))
         handle_outofbound<Error::InsOutOfBound, command_size_t>(pc);
 
-    return int_cast<target_size_t>(this->get_static(pc));
+    return int_cast<target_size_t>(this->get_host(pc));
 }
 
+template <std::integral _Int>
+[[noreturn]]
+static void handle_overflow(target_size_t addr) {
+    throw FailToInterpret{
+        .error = Error::StackOverflow, .detail = {.address = addr, .size = sizeof(_Int)}
+    };
+}
+
+/**
+ * An access out of all the normal areas, which may be a mapped device,
+ * or the stack running out. Any other one is out of bound.
+ */
+template <std::integral _Int>
+auto Memory_Impl::outside_load(target_size_t addr) -> _Int {
+    if (this->in_guard(addr, HeapArea::get_range().finish))
+        handle_overflow<_Int>(addr);
+
+    if (auto *entry = this->find_mapped(addr, addr + sizeof(_Int)))
+        return static_cast<_Int>(entry->device->load(addr - entry->range.start, sizeof(_Int)));
+
+    handle_outofbound<Error::LoadOutOfBound, _Int>(addr);
+}
+
+template <std::unsigned_integral _Int>
+void Memory_Impl::outside_store(target_size_t addr, _Int val) {
+    if (this->in_guard(addr, HeapArea::get_range().finish))
+        handle_overflow<_Int>(addr);
+
+    if (auto *entry = this->find_mapped(addr, addr + sizeof(_Int)))
+        return entry->device->store(addr - entry->range.start, sizeof(_Int), val);
+
+    handle_outofbound<Error::StoreOutOfBound, _Int>(addr);
+}
+
+#if defined(REIMU_GUARD_PAGES)
+
+/**
+ * With guard pages, an access out of the committed pages faults, and the
+ * fault is turned into a GuardFault, see simulation/area.h. Aligned accesses
+ * never cross a page, so no range check is needed, except that the text is
+ * readable by the host for fetching, but not by loads, and data starts on
+ * a fresh page after it.
+ */
+
 template <std::integral _Int>
 auto Memory_Impl::checked_load(target_size_t addr) -> _Int {
     if (addr % alignof(_Int) != 0)
         handle_misaligned<Error::LoadMisAligned, _Int>(addr);
 
-    if (addr >= target_size_t(-sizeof(_Int)))
-        handle_outofbound<Error::LoadOutOfBound, _Int>(addr);
+    if (addr < this->get_data_range().start) [[unlikely]]
+        return this->outside_load<_Int>(addr);
 
-    if (this->in_data(addr, addr + sizeof(_Int)))
-        return int_cast<_Int>(this->get_static(addr));
+    try {
+        return int_cast<_Int>(this->get_host(addr));
+    } catch (GuardFault &) { return this->outside_load<_Int>(addr); }
+}
 
-    if (this->in_heap(addr, addr + sizeof(_Int)))
-        return int_cast<_Int>(this->get_heap(addr));
+template <std::unsigned_integral _Int>
+void Memory_Impl::check_store(target_size_t addr, _Int val) {
+    if (addr % alignof(_Int) != 0)
+        handle_misaligned<Error::StoreMisAligned, _Int>(addr);
 
-    if (this->in_stack(addr, addr + sizeof(_Int)))
-        return int_cast<_Int>(this->get_stack(addr));
+    try {
+        int_cast<_Int>(this->get_host(addr)) = val;
+    } catch (GuardFault &) { this->outside_store(addr, val); }
+}
 
-    handle_outofbound<Error::LoadOutOfBound, _Int>(addr);
+#else // !REIMU_GUARD_PAGES
+
+/**
+ * Most accesses hit the cache of areas, which also covers the alignment.
+ * All the checks are only done one by one on a miss.
+ */
+
+template <std::integral _Int>
+auto Memory_Impl::checked_load(target_size_t addr) -> _Int {
+    if (this->hit<_Int>(addr)) [[likely]]
+        return int_cast<_Int>(this->get_host(addr));
+
+    if (addr % alignof(_Int) != 0)
+        handle_misaligned<Error::LoadMisAligned, _Int>(addr);
+
+    if (addr >= target_size_t(-sizeof(_Int)))
+        handle_outofbound<Error::LoadOutOfBound, _Int>(addr);
+
+    if (this->accessible(addr, addr + sizeof(_Int))) [[likely]]
+        return int_cast<_Int>(this->get_host(addr));
+
+    return this->outside_load<_Int>(addr);
 }
 
 template <std::unsigned_integral _Int>
 void Memory_Impl::check_store(target_size_t addr, _Int val) {
+    if (this->hit<_Int>(addr)) [[likely]]
+        return void(int_cast<_Int>(this->get_host(addr)) = val);
+
     if (addr % alignof(_Int) != 0)
         handle_misaligned<Error::StoreMisAligned, _Int>(addr);
 
     if (addr >= -sizeof(_Int))
         handle_outofbound<Error::LoadOutOfBound, _Int>(addr);
 
-    if (this->in_data(addr, addr + sizeof(_Int)))
-        return void(int_cast<_Int>(this->get_static(addr)) = val);
-
-    if (this->in_heap(addr, addr + sizeof(_Int)))
-        return void(int_cast<_Int>(this->get_heap(addr)) = val);
-
-    if (this->in_stack(addr, addr + sizeof(_Int)))
-        return void(int_cast<_Int>(this->get_stack(addr)) = val);
+    if (this->accessible(addr, addr + sizeof(_Int))) [[likely]]
+        return void(int_cast<_Int>(this->get_host(addr)) = val);
 
-    handle_outofbound<Error::StoreOutOfBound, _Int>(addr);
+    this->outside_store(addr, val);
 }
 
+#endif // REIMU_GUARD_PAGES
+
 auto Memory_Impl::get_segment(target_size_t addr) -> std::span<char> {
     constexpr auto __wash = [](std::byte *ptr) -> char * {
         /// TODO: May be we should use std::launder here
@@ -215,14 +468,8 @@ auto Memory_Impl::get_segment(target_size_t addr) -> std::span<char> {
         return std::bit_cast<char *>(ptr);
     };
 
-    if (auto [low, top] = StaticArea::get_data_range(); low <= addr && addr <= top)
-        return {__wash(this->get_static(addr)), top - addr};
-
-    if (auto [low, top] = HeapArea::get_range(); low <= addr && addr <= top)
-        return {__wash(this->get_heap(addr)), top - addr};
-
-    if (auto [low, top] = StackArea::get_range(); low <= addr && addr <= top)
-        return {__wash(this->get_stack(addr)), top - addr};
+    if (const auto finish = this->translate(addr, addr); finish != 0)
+        return {__wash(this->get_host(addr)), finish - addr};
 
     return {}; // Not found.
 }
@@ -1,6 +1,7 @@
 #include "assembly/layout.h"
 #include "config/config.h"
 #include "interpreter/interpreter.h"
+#include "interpreter/memory.h"
 #include "linker/layout.h"
 #include "linker/linker.h"
 #include "utility/error.h"
@@ -50,6 +51,8 @@ void Interpreter::link() {
     if (config.has_option("detail"))
         print_link_result(result);
 
+    // Built once here, so that every run can map it instead of copying.
+    this->memory_image  = Memory::snapshot(result);
     this->memory_layout = std::move(result);
 }
 
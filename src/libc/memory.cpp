@@ -78,8 +78,7 @@ auto memcpy(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr0       = rf[Register::a0];
     auto ptr1       = rf[Register::a1];
     auto size       = rf[Register::a2];
-    auto [dst, src] = checked_get_areas<_Index::memcpy>(mem, ptr0, ptr1, size);
-    std::memcpy(dst, src, size);
+    checked_copy<_Index::memcpy>(mem, ptr0, ptr1, size);
 
     dev.counter.libcOp += kLibcOverhead + op(size * 2);
 
@@ -90,8 +89,7 @@ auto memmove(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr0       = rf[Register::a0];
     auto ptr1       = rf[Register::a1];
     auto size       = rf[Register::a2];
-    auto [dst, src] = checked_get_areas<_Index::memmove>(mem, ptr0, ptr1, size);
-    std::memmove(dst, src, size);
+    checked_copy<_Index::memmove>(mem, ptr0, ptr1, size);
 
     dev.counter.libcOp += kLibcOverhead + op(size * 2);
 
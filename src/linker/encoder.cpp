@@ -16,6 +16,7 @@
 #include <cctype>
 #include <string>
 #include <string_view>
+#include <unordered_set>
 
 namespace dark {
 
@@ -415,6 +416,15 @@ static void connect(Encoder::Section &prev, Encoder::Section &next) {
         next.start = prev.start + prev.storage.size();
 }
 
+#if defined(REIMU_GUARD_PAGES)
+/* Like connect, but the next one starts on a fresh page, as the text is sealed by pages. */
+static void connect_page(Encoder::Section &prev, Encoder::Section &next) {
+    constexpr target_size_t kPageSize = 0x1000;
+    if (next.storage.empty())
+        next.start = (prev.start + prev.storage.size() + kPageSize - 1) & ~(kPageSize - 1);
+}
+#endif
+
 /**
  * Link these targeted files.
  * It will translate all symbols into integer constants.
@@ -425,6 +435,14 @@ void Linker::link() {
     for (auto &[name, location] : this->global_symbol_table)
         result.position_table.emplace(name, location.get_location());
 
+    // Each file has one local table, shared by all its storages.
+    std::unordered_set<const _Symbol_Table_t *> local_tables;
+    for (auto &details : this->get_section(Section::TEXT))
+        local_tables.insert(details.get_local_table());
+    for (const auto *local : local_tables)
+        for (auto &[name, location] : *local)
+            result.local_table.emplace(name, location.get_location());
+
     auto &table = this->global_symbol_table;
 
     result.text.start = libc::kLibcEnd;
@@ -437,7 +455,11 @@ void Linker::link() {
 
     runtime_assert(result.text.start == libc::kLibcEnd);
 
+#if defined(REIMU_GUARD_PAGES)
+    connect_page(result.text, result.data);
+#else
     connect(result.text, result.data);
+#endif
     connect(result.data, result.rodata);
     connect(result.rodata, result.unknown);
     connect(result.unknown, result.bss);
@@ -1,11 +1,14 @@
 #include "config/config.h"
 #include "config/argument.h"
+#include "config/cache.h"
 #include "config/counter.h"
 #include "config/default.h"
+#include "config/predictor.h"
 #include "utility/cast.h"
 #include "utility/error.h"
 #include "utility/tagged.h"
 #include <concepts>
+#include <bit>
 #include <cstddef>
 #include <cstdlib>
 #include <filesystem>
@@ -152,6 +155,9 @@ struct Config_Impl {
     const std::size_t stack_size  = {}; // Maximum stack
 
     const std::vector<std::string_view> assembly_files; // Assembly files
+    const std::vector<cache::Level> cache_levels;       // Data cache, from L1D on
+    const cache::Level icache_level;                    // Instruction cache
+    const predictor::Kind predictor;                    // Branch predictor
 
     // The additional configuration table provided by the user.
     _Option_Set_t option_table;
@@ -295,7 +301,7 @@ static auto get_memory(std::string_view str, std::string_view what) -> std::size
 }
 
 [[maybe_unused]]
-static auto get_files(std::string_view str) -> std::vector<std::string_view> {
+static auto get_list(std::string_view str) -> std::vector<std::string_view> {
     std::vector<std::string_view> files;
     std::size_t next = str.find_first_of(',');
     while (next != std::string_view::npos) {
@@ -307,6 +313,87 @@ static auto get_files(std::string_view str) -> std::vector<std::string_view> {
     return files;
 }
 
+static auto get_policy(std::string_view str, std::string_view what) -> cache::Policy {
+    if (str == "lru")
+        return cache::Policy::LRU;
+    if (str == "plru")
+        return cache::Policy::PLRU;
+    if (str == "random")
+        return cache::Policy::Random;
+    if (str == "fifo")
+        return cache::Policy::FIFO;
+    handle_error("{} has an unknown replacement policy: {}", what, str);
+}
+
+static auto get_predictor(std::string_view str, std::string_view what) -> predictor::Kind {
+    if (str == "bimodal")
+        return predictor::Kind::Bimodal;
+    if (str == "gshare")
+        return predictor::Kind::Gshare;
+    if (str == "tournament")
+        return predictor::Kind::Tournament;
+    if (str == "tage")
+        return predictor::Kind::Tage;
+    handle_error("{} has an unknown branch predictor: {}", what, str);
+}
+
+static auto get_switch(
+    std::string_view str, std::string_view what, std::string_view on, std::string_view off
+) -> bool {
+    if (str == on)
+        return true;
+    if (str == off)
+        return false;
+    handle_error("{} expects {} or {}: {}", what, on, off, str);
+}
+
+static void check_cache_level(const cache::Level &level, std::string_view what) {
+    if (!std::has_single_bit(level.line) || level.line < sizeof(target_size_t))
+        handle_error("{} line size must be a power of 2, at least 4: {}", what, level.line);
+    if (level.ways == 0 || level.ways > 64)
+        handle_error("{} ways must be from 1 to 64: {}", what, level.ways);
+    if (level.size % (level.ways * level.line) != 0)
+        handle_error("{} size must be a multiple of ways * line: {}", what, level.size);
+    if (const auto sets = level.size / (level.ways * level.line); !std::has_single_bit(sets))
+        handle_error("{} number of sets must be a power of 2: {}", what, sets);
+    if (level.policy == cache::Policy::PLRU && !std::has_single_bit(level.ways))
+        handle_error("{} ways must be a power of 2 for plru: {}", what, level.ways);
+}
+
+/**
+ * Parse a cache level from a list of key=value, e.g. size=32K,ways=8.
+ * Keys not given are left as in the initial value.
+ */
+static auto get_cache_level(std::string_view str, std::string_view what, cache::Level level)
+    -> cache::Level {
+    for (auto item : get_list(str)) {
+        const auto pos = item.find('=');
+        if (pos == item.npos)
+            handle_error("{} expects <key>=<value>: {}", what, item);
+        const auto key   = item.substr(0, pos);
+        const auto value = item.substr(pos + 1);
+        if (key == "size") {
+            level.size = get_memory(value, what);
+        } else if (key == "ways") {
+            level.ways = get_integer(value, what);
+        } else if (key == "line") {
+            level.line = get_integer(value, what);
+        } else if (key == "policy") {
+            level.policy = get_policy(value, what);
+        } else if (key == "write") {
+            level.write_back = get_switch(value, what, "back", "through");
+        } else if (key == "allocate") {
+            level.write_allocate = get_switch(value, what, "on", "off");
+        } else if (key == "latency") {
+            level.latency = get_integer(value, what);
+        } else {
+            handle_error("{} has an unknown key: {}", what, key);
+        }
+    }
+    check_cache_level(level, what);
+    return level;
+}
+
 static auto make_memory_string(std::size_t size) -> std::string {
     constexpr std::size_t kMin = (std::size_t(1) << 20) / 10;
     if (size < kMin) {
@@ -317,6 +404,22 @@ static auto make_memory_string(std::size_t size) -> std::string {
 }
 
 using enum ArgumentParser::Rule;
+
+static auto get_cache_levels(ArgumentParser &parser) -> std::vector<cache::Level> {
+    std::vector<cache::Level> levels;
+    levels.push_back(parser.match<KeyValue>({"--l1d"})
+                         .transform([](std::string_view str) {
+                             return get_cache_level(str, "--l1d", config::kInitL1D);
+                         })
+                         .value_or(config::kInitL1D));
+    if (auto str = parser.match<KeyValue>({"--l2"})) {
+        levels.push_back(get_cache_level(*str, "--l2", config::kInitL2));
+        if (levels[1].line < levels[0].line)
+            handle_error("--l2 line size must not be less than --l1d: {}", levels[1].line);
+    }
+    return levels;
+}
+
 /**
  * Core implementation of the configuration parser.
  */
@@ -335,8 +438,17 @@ Config_Impl::Config_Impl(ArgumentParser &parser) :
                    .transform([](std::string_view str) { return get_memory(str, "--stack"); })
                    .value_or(config::kInitStackSize)),
     assembly_files(parser.match<KeyValue>({"-f", "--file"})
-                       .transform(get_files)
+                       .transform(get_list)
                        .value_or(config::kInitAssemblyFiles)),
+    cache_levels(get_cache_levels(parser)),
+    icache_level(parser.match<KeyValue>({"--l1i"})
+                     .transform([](std::string_view str) {
+                         return get_cache_level(str, "--l1i", config::kInitL1I);
+                     })
+                     .value_or(config::kInitL1I)),
+    predictor(parser.match<KeyValue>({"--bp"})
+                  .transform([](std::string_view str) { return get_predictor(str, "--bp"); })
+                  .value_or(config::kInitPredictor)),
     option_table() {
     for (auto option : config::kSupportedOptions)
         parser.match<KeyOnly>({option}, [this, option]() {
@@ -597,6 +709,18 @@ auto Config::get_timeout() const -> std::size_t {
     return this->get_impl().max_timeout;
 }
 
+auto Config::get_cache_levels() const -> std::span<const cache::Level> {
+    return this->get_impl().cache_levels;
+}
+
+auto Config::get_icache_level() const -> const cache::Level & {
+    return this->get_impl().icache_level;
+}
+
+auto Config::get_predictor() const -> predictor::Kind {
+    return this->get_impl().predictor;
+}
+
 auto Config::get_assembly_names() const -> std::span<const std::string_view> {
     return this->get_impl().assembly_files;
 }
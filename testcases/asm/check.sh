@@ -0,0 +1,36 @@
+# Usage: sh check.sh <file.s> [<file.s> ...]
+#
+# Run each program once for each "# Options:" line in it, and check that
+# every "# Expect:" line after that one shows up as a whole line of the
+# output, i.e. the program output and the profile, with no colors and no
+# leading or trailing spaces. The simulator is $REIMU, or reimu by default.
+
+reimu=${REIMU:-reimu}
+status=0
+
+for file in "$@"; do
+    runs=$(grep -c "^# Options:" $file)
+    for run in $(seq 1 $runs); do
+        options=$(awk -v run=$run '/^# Options:/ && ++count == run {
+            sub(/^# Options: */, ""); print
+        }' $file)
+        output=$(eval "$reimu -f=$file -i=/dev/null -o='<stdout>' $options" 2>&1 \
+            | tr -d '\0' | sed 's/\x1b\[[0-9;]*m//g; s/^ *//; s/ *$//')
+
+        missing=$(awk -v run=$run '/^# Options:/ { ++count } count == run && /^# Expect:/ {
+            sub(/^# Expect: */, ""); print
+        }' $file | while IFS= read -r line; do
+            printf '%s\n' "$output" | grep -a -q -x -F -- "$line" || echo "    $line"
+        done)
+
+        if [ -z "$missing" ]; then
+            echo "\033[32m$file${options:+ $options}: ok\033[0m"
+        else
+            echo "\033[31m$file${options:+ $options}: missing\033[0m"
+            echo "$missing"
+            status=1
+        fi
+    done
+done
+
+exit $status
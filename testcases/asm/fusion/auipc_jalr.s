@@ -0,0 +1,68 @@
+# auipc + jalr, as a call in a loop, and as the jump to the end itself.
+# The text starts at 0x1004c, so the call at 0x1005c adds 0x24 to reach
+# square at 0x10080. The program ends by jumping to pc = 4, so the auipc
+# at 0x10078 gives 0x10078 - 0x10000 and the jalr adds 4 - 0x78 to it.
+# The counters are those of the unfused run under --debug. The least time
+# limit for the whole program is the last one, and the one 1 below it
+# stops right between the halves of the last pair, where running on
+# through the jalr would end the program instead.
+# Options: --detail
+# Expect: Exit code: 338350
+# Expect: Total cycles: 2208
+# Expect: Instruction counts:
+# Expect: # simple   = 406
+# Expect: # mul      = 100
+# Expect: # div      = 0
+# Expect: # mem      = 0
+# Expect: # branch   = 100
+# Expect: # jump     = 0
+# Expect: # jalr     = 201
+# Expect: # libcMem  = 0
+# Expect: # libcIO   = 0
+# Expect: # libcOp   = 0
+# Options: --all --btb --detail
+# Expect: Exit code: 338350
+# Expect: Total cycles: 1432
+# Expect: Instruction counts:
+# Expect: # simple   = 406
+# Expect: # mul      = 100
+# Expect: # div      = 0
+# Expect: # mem      = 0
+# Expect: # branch   = 100
+# Expect: # jump     = 0
+# Expect: # jalr     = 201
+# Expect: # libcMem  = 0
+# Expect: # libcIO   = 0
+# Expect: # libcOp   = 0
+# Expect: Branch prediction taken rate: 99.00% (99/100) by bimodal
+# Expect: Jump target prediction rate: 98.02% (99/101)
+# Expect: Return address prediction rate: 100.00% (100/100)
+# Expect: Cache lines from memory: 0, to memory: 0
+# Options: -t=805
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=806
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=807
+# Expect: Exit code: 338350
+    .text
+    .align    2
+    .globl    main
+main:
+    mv s3, ra
+    li s0, 100
+    li s1, 0
+.loop:
+    mv a0, s0
+    auipc ra, 0
+    jalr ra, 36(ra)
+    add s1, s1, a0
+    addi s0, s0, -1
+    bnez s0, .loop
+    mv a0, s1
+    mv ra, s3
+    auipc t1, 0xffff0
+    jalr zero, -116(t1)
+
+square:
+    mul a0, a0, a0
+    ret
@@ -0,0 +1,58 @@
+# lui + addi of the same register, in a loop and right before the end.
+# The counters are those of the unfused run under --debug. The least time
+# limit for the whole program is the last one, and the one 2 below it
+# stops right between the halves of the last pair.
+# Options: --detail
+# Expect: Exit code: 305419895
+# Expect: Total cycles: 1507
+# Expect: Instruction counts:
+# Expect: # simple   = 505
+# Expect: # mul      = 0
+# Expect: # div      = 0
+# Expect: # mem      = 0
+# Expect: # branch   = 100
+# Expect: # jump     = 0
+# Expect: # jalr     = 1
+# Expect: # libcMem  = 0
+# Expect: # libcIO   = 0
+# Expect: # libcOp   = 0
+# Options: --all --btb --detail
+# Expect: Exit code: 305419895
+# Expect: Total cycles: 723
+# Expect: Instruction counts:
+# Expect: # simple   = 505
+# Expect: # mul      = 0
+# Expect: # div      = 0
+# Expect: # mem      = 0
+# Expect: # branch   = 100
+# Expect: # jump     = 0
+# Expect: # jalr     = 1
+# Expect: # libcMem  = 0
+# Expect: # libcIO   = 0
+# Expect: # libcOp   = 0
+# Expect: Branch prediction taken rate: 99.00% (99/100) by bimodal
+# Expect: Return address prediction rate: 0.00% (0/1)
+# Expect: Cache lines from memory: 0, to memory: 0
+# Options: -t=604
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=605
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=606
+# Expect: Exit code: 305419895
+    .text
+    .align    2
+    .globl    main
+main:
+    li s0, 100
+    li s1, 0
+.loop:
+    lui t0, 0x12345
+    addi t0, t0, 0x678
+    add s1, s1, t0
+    srli s1, s1, 1
+    addi s0, s0, -1
+    bnez s0, .loop
+    mv a0, s1
+    lui t0, 0x1
+    addi t0, t0, -1
+    ret
@@ -0,0 +1,63 @@
+# slli + add, to index an array, in a loop and right before the end.
+# The counters are those of the unfused run under --debug. The least time
+# limit for the whole program is the last one, and the one 2 below it
+# stops right between the halves of the last pair.
+# Options: --detail
+# Expect: Exit code: 4950
+# Expect: Total cycles: 14308
+# Expect: Instruction counts:
+# Expect: # simple   = 506
+# Expect: # mul      = 0
+# Expect: # div      = 0
+# Expect: # mem      = 200
+# Expect: # branch   = 100
+# Expect: # jump     = 0
+# Expect: # jalr     = 1
+# Expect: # libcMem  = 0
+# Expect: # libcIO   = 0
+# Expect: # libcOp   = 0
+# Options: --all --btb --detail
+# Expect: Exit code: 4950
+# Expect: Total cycles: 1944
+# Expect: Instruction counts:
+# Expect: # simple   = 506
+# Expect: # mul      = 0
+# Expect: # div      = 0
+# Expect: # mem      = 200
+# Expect: # branch   = 100
+# Expect: # jump     = 0
+# Expect: # jalr     = 1
+# Expect: # libcMem  = 0
+# Expect: # libcIO   = 0
+# Expect: # libcOp   = 0
+# Expect: Branch prediction taken rate: 99.00% (99/100) by bimodal
+# Expect: Return address prediction rate: 0.00% (0/1)
+# Expect: Cache hit rate: 96.50% (193/200)
+# Expect: Cache lines from memory: 7, to memory: 0
+# Options: -t=805
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=806
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=807
+# Expect: Exit code: 4950
+    .text
+    .align    2
+    .globl    main
+main:
+    addi s2, sp, -400
+    li s0, 0
+    li s1, 0
+.loop:
+    slli t0, s0, 2
+    add t0, t0, s2
+    sw s0, 0(t0)
+    lw t1, 0(t0)
+    add s1, s1, t1
+    addi s0, s0, 1
+    slti t1, s0, 100
+    bnez t1, .loop
+    mv a0, s1
+    slli t0, s0, 3
+    add t0, s2, t0
+    ret
+
@@ -0,0 +1,65 @@
+# slt(u) + beqz/bnez, taken and not, in a loop and right before the end.
+# The counters are those of the unfused run under --debug. The least time
+# limit for the whole program is the last one, and the one 2 below it
+# stops right between the halves of the last pair.
+# Options: --detail
+# Expect: Exit code: 200
+# Expect: Total cycles: 2468
+# Expect: Instruction counts:
+# Expect: # simple   = 406
+# Expect: # mul      = 0
+# Expect: # div      = 0
+# Expect: # mem      = 0
+# Expect: # branch   = 201
+# Expect: # jump     = 50
+# Expect: # jalr     = 1
+# Expect: # libcMem  = 0
+# Expect: # libcIO   = 0
+# Expect: # libcOp   = 0
+# Options: --all --btb --detail
+# Expect: Exit code: 200
+# Expect: Total cycles: 916
+# Expect: Instruction counts:
+# Expect: # simple   = 406
+# Expect: # mul      = 0
+# Expect: # div      = 0
+# Expect: # mem      = 0
+# Expect: # branch   = 201
+# Expect: # jump     = 50
+# Expect: # jalr     = 1
+# Expect: # libcMem  = 0
+# Expect: # libcIO   = 0
+# Expect: # libcOp   = 0
+# Expect: Branch prediction taken rate: 97.51% (196/201) by bimodal
+# Expect: Jump target prediction rate: 98.00% (49/50)
+# Expect: Return address prediction rate: 0.00% (0/1)
+# Expect: Cache lines from memory: 0, to memory: 0
+# Options: -t=656
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=657
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=658
+# Expect: Exit code: 200
+    .text
+    .align    2
+    .globl    main
+main:
+    li s0, 0
+    li s1, 0
+    li s2, 50
+    li s3, 100
+.loop:
+    slt t0, s0, s2
+    beqz t0, .high
+    addi s1, s1, 1
+    j .next
+.high:
+    addi s1, s1, 3
+.next:
+    addi s0, s0, 1
+    sltu t1, s0, s3
+    bnez t1, .loop
+    mv a0, s1
+    sltu t0, a0, zero
+    bnez t0, .loop
+    ret
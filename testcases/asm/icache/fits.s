@@ -0,0 +1,51 @@
+# A loop of 32 instructions, i.e. 8 lines of 16 bytes, run 100 times,
+# under a fully associative cache of 16 lines. The text starts at 0x1004c,
+# so the first run reads 9 lines and the end reads 1 more, all missed once,
+# while the other 99 runs hit all their 8 lines. The default 4K cache of
+# 64-byte lines misses only the 3 lines of the first run.
+# Options: --icache --l1i=size=256,ways=16,line=16
+# Expect: Exit code: 3000
+# Expect: Instruction cache hit rate: 98.75% (792/802)
+# Options: --icache
+# Expect: Exit code: 3000
+# Expect: Instruction cache hit rate: 99.00% (298/301)
+    .text
+    .align    2
+    .globl    main
+main:
+    li t0, 100
+.loop:
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t0, t0, -1
+    bnez t0, .loop
+    mv a0, t1
+    ret
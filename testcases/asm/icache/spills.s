@@ -0,0 +1,115 @@
+# A loop of 96 instructions, i.e. 24 lines of 16 bytes, run 100 times,
+# under a fully associative cache of 16 lines. The first run reads 25 lines
+# and the end reads 1 more, and as the loop is larger than the cache, LRU
+# misses all the 24 lines of the other 99 runs too. The default 4K cache
+# of 64-byte lines misses only the 7 lines of the first run.
+# Options: --icache --l1i=size=256,ways=16,line=16
+# Expect: Exit code: 9400
+# Expect: Instruction cache hit rate: 0.00% (0/2402)
+# Options: --icache
+# Expect: Exit code: 9400
+# Expect: Instruction cache hit rate: 99.00% (694/701)
+    .text
+    .align    2
+    .globl    main
+main:
+    li t0, 100
+.loop:
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t1, t1, 1
+    addi t0, t0, -1
+    bnez t0, .loop
+    mv a0, t1
+    ret
@@ -0,0 +1,64 @@
+# A hot loop of register-only work, with loads and stores in between,
+# which the native tier translates after a few runs.
+# Expected: the same output and counters as the interpreter.
+# Options:
+# Expect: 112752 436
+# Expect: Exit code: 0
+# Expect: Total cycles: 286268
+# Expect: Instruction counts:
+# Expect: # simple   = 12011
+# Expect: # mul      = 2000
+# Expect: # div      = 0
+# Expect: # mem      = 4002
+# Expect: # branch   = 1000
+# Expect: # jump     = 1
+# Expect: # jalr     = 1
+# Expect: # libcMem  = 0
+# Expect: # libcIO   = 1
+# Expect: # libcOp   = 0
+# Options: --cache --detail
+# Expect: Total cycles: 46208
+# Expect: Cache hit rate: 99.98% (4001/4002)
+# Expect: Cache lines from memory: 1, to memory: 0
+    .text
+    .align    2
+    .globl    main
+main:
+    addi sp, sp, -32
+    sw ra, 28(sp)
+    li t0, 1000
+    li t1, 0x12345
+    li t2, 7
+.loop:
+    add t3, t1, t0
+    sub t4, t3, t2
+    xor t1, t4, t3
+    slli t5, t1, 3
+    srai t6, t5, 2
+    sltu a2, t6, t1
+    mul a3, t1, t2
+    mulh a4, t1, t3
+    or t1, a3, a2
+    and a4, a4, t6
+    sw t1, 0(sp)
+    lw a5, 0(sp)
+    add t1, a5, a4
+    sb t1, 4(sp)
+    lbu a6, 4(sp)
+    add t2, t2, a6
+    andi t2, t2, 0x3ff
+    addi t0, t0, -1
+    bnez t0, .loop
+
+    la a0, .format
+    mv a1, t1
+    mv a2, t2
+    call printf
+    lw ra, 28(sp)
+    addi sp, sp, 32
+    li a0, 0
+    ret
+
+    .rodata
+.format:
+    .string    "%d %d\n"
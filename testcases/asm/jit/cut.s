@@ -0,0 +1,42 @@
+# A hot loop which runs natively, with time limits which land inside it.
+# The whole program is 2 + 500 * 7 + 2 = 3504 commands, and the last run
+# of the loop is from the 2997th to the 3502nd.
+# Expected: Time Limit Exceeded below 3504, and a normal exit at it.
+# Options: -t=2996
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=3000
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=3501
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=3503
+# Expect: Fatal error: Time Limit Exceeded
+# Options: -t=3504
+# Expect: Exit code: 500
+# Expect: Total cycles: 8005
+# Expect: Instruction counts:
+# Expect: # simple   = 3003
+# Expect: # mul      = 0
+# Expect: # div      = 0
+# Expect: # mem      = 0
+# Expect: # branch   = 500
+# Expect: # jump     = 0
+# Expect: # jalr     = 1
+# Expect: # libcMem  = 0
+# Expect: # libcIO   = 0
+# Expect: # libcOp   = 0
+    .text
+    .align    2
+    .globl    main
+main:
+    li t0, 500
+    li t1, 0
+.loop:
+    addi t1, t1, 3
+    xor t2, t1, t0
+    slli t2, t2, 1
+    add t1, t1, t2
+    andi t1, t1, 0x7ff
+    addi t0, t0, -1
+    bnez t0, .loop
+    mv a0, t1
+    ret
@@ -0,0 +1,58 @@
+# A hot loop of div and rem, by -1 among others, with the most negative
+# dividend too, which overflows.
+# Expected: the same output and counters as the interpreter.
+# Options:
+# Expect: 1073724723 -1073745973
+# Expect: Exit code: 0
+# Expect: Total cycles: 30963
+# Expect: Instruction counts:
+# Expect: # simple   = 3610
+# Expect: # mul      = 0
+# Expect: # div      = 1200
+# Expect: # mem      = 2
+# Expect: # branch   = 300
+# Expect: # jump     = 1
+# Expect: # jalr     = 1
+# Expect: # libcMem  = 0
+# Expect: # libcIO   = 1
+# Expect: # libcOp   = 0
+    .text
+    .align    2
+    .globl    main
+main:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    li t0, 300
+    li t1, 0
+    li t2, 0
+.loop:
+    andi t3, t0, 3
+    addi t3, t3, -1        # -1, 0, 1 and 2, but 0 is never used
+    seqz t4, t3
+    add t3, t3, t4         # -1, 1, 1 and 2
+    li t5, 0x80000000
+    add t5, t5, t0
+    addi t5, t5, -300      # The most negative one last
+    div a2, t5, t3
+    rem a3, t5, t3
+    divu a4, t5, t3
+    remu a5, t5, t3
+    add t1, t1, a2
+    xor t1, t1, a3
+    add t2, t2, a4
+    xor t2, t2, a5
+    addi t0, t0, -1
+    bnez t0, .loop
+
+    la a0, .format
+    mv a1, t1
+    mv a2, t2
+    call printf
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    li a0, 0
+    ret
+
+    .rodata
+.format:
+    .string    "%d %d\n"
@@ -0,0 +1,23 @@
+# A hot loop of div, whose divisor reaches 0 after many runs.
+# Expected: Divide by zero at the div, as in the interpreter.
+# Options:
+# Expect: Fatal error: Fail to execute the program.
+# Expect: Divide by zero at 0x1006c
+    .text
+    .align    2
+    .globl    main
+main:
+    li t0, 200
+    li t1, 0
+.loop:
+    li t2, 100000
+    addi t3, t1, 1
+    xor t4, t3, t0
+    slli t4, t4, 1
+    add t1, t1, t4
+    div t5, t2, t0
+    add t1, t1, t5
+    addi t0, t0, -1
+    bgez t0, .loop
+    li a0, 0
+    ret
@@ -0,0 +1,25 @@
+# A hot loop of loads walking up past the end of the static data.
+# Expected: Load out of bound at the first word past it, as in the
+# interpreter, and no line written past the one before.
+# Options:
+# Expect: Fatal error: Fail to execute the program.
+# Expect: Load out of bound at 0x12000 | size = 4
+    .text
+    .align    2
+    .globl    main
+main:
+    la t0, buffer
+    li t1, 0
+.loop:
+    lw t2, 0(t0)
+    addi t1, t1, 1
+    xor t3, t1, t2
+    slli t3, t3, 2
+    add t4, t3, t1
+    addi t0, t0, 4
+    j .loop
+
+    .bss
+    .align    12
+buffer:
+    .zero    4096
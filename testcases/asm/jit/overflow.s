@@ -0,0 +1,20 @@
+# A hot loop of stores walking down the stack, far past its bottom.
+# Expected: Stack overflow at the first word below the stack, reported
+# at the store, as in the interpreter.
+# Options:
+# Expect: Fatal error: Fail to execute the program.
+# Expect: Stack overflow at 0xfff7ffc | depth = 32772 bytes | in main (pc = 0x10068)
+    .text
+    .align    2
+    .globl    main
+main:
+    mv t0, sp
+    li t1, 0
+.loop:
+    addi t0, t0, -4
+    addi t1, t1, 1
+    xor t2, t1, t0
+    slli t2, t2, 1
+    add t3, t2, t1
+    sw t3, 0(t0)
+    j .loop
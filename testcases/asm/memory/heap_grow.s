@@ -0,0 +1,46 @@
+# The last word of the heap loaded and stored, so that its page is cached,
+# then the heap grown by malloc, 1 KiB at a time, past that page.
+# The bss takes a whole page, so the heap starts at 0x13000 with guard
+# pages or not, and it ends at a page boundary, 0x15000.
+# Expected: each new last word is accessible at once, and a store right
+# past the end is out of bound.
+# Options:
+# Expect: Store out of bound at 0x15000 | size = 4
+    .text
+    .align    2
+    .globl    main
+main:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    sw s0, 8(sp)
+    sw s1, 4(sp)
+    # A block of n bytes takes n + 8, aligned to 16, from the old end.
+    # The first one starts 16 bytes in, so it ends 1 KiB in.
+    li a0, 1000
+    call malloc
+    addi s0, a0, 1008
+    li s1, 7
+.loop:
+    lw t0, -4(s0)
+    addi t0, t0, 1
+    sw t0, -4(s0)
+    li a0, 1016
+    call malloc
+    bne a0, s0, .fail
+    addi s0, a0, 1024
+    addi s1, s1, -1
+    bnez s1, .loop
+    lw t0, -4(s0)
+    sw t0, 0(s0)
+.fail:
+    lw s1, 4(sp)
+    lw s0, 8(sp)
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    li a0, 1
+    ret
+
+    .bss
+    .align    12
+padding:
+    .zero    4096
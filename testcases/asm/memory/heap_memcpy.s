@@ -0,0 +1,47 @@
+# memcpy from the last 32 bytes of the bss across a page boundary inside
+# the heap, right after the heap has grown past it, then across the end
+# of the heap by 1 byte.
+# The bss takes a whole page, so the heap starts at 0x13000 with guard
+# pages or not, and it ends at a page boundary, 0x15000.
+# Expected: the first one is fine, and the second one is out of bound.
+# Options:
+# Expect: libc::memcpy out of bound at 0x15001 | size = 1
+    .text
+    .align    2
+    .globl    main
+main:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    sw s0, 8(sp)
+    # A block of n bytes takes n + 8, aligned to 16, from the old end.
+    # The first one starts 16 bytes in, so it ends 1 KiB in.
+    li a0, 1000
+    call malloc
+    li a0, 7160
+    call malloc
+    li t0, 7168
+    add s0, a0, t0
+    # From 16 bytes below the page boundary at 0x14000 to 16 above it.
+    li t0, 4112
+    sub a0, s0, t0
+    la a1, padding
+    addi a1, a1, 2047
+    addi a1, a1, 2017
+    li a2, 32
+    call memcpy
+    addi a0, s0, -16
+    la a1, padding
+    addi a1, a1, 2047
+    addi a1, a1, 2017
+    li a2, 17
+    call memcpy
+    lw s0, 8(sp)
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    li a0, 0
+    ret
+
+    .bss
+    .align    12
+padding:
+    .zero    4096
@@ -0,0 +1,29 @@
+# The heap grown as close to the stack as it may be, then a store
+# 1 KiB past its end, which is still far from the stack.
+# Expected: Store out of bound, not a stack overflow.
+    .text
+    .align    2
+    .globl    main
+main:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    sw s0, 8(sp)
+    # The heap may end up to 64 KiB below the 32 KiB stack.
+    # Grow it to about 256 bytes short of that.
+    li a0, 16
+    call malloc
+    addi t0, sp, 16
+    li t1, 0x18100
+    sub t0, t0, t1
+    sub a0, t0, a0
+    call malloc
+    mv s0, a0
+    addi t0, sp, 16
+    li t1, 0x17d00
+    sub t0, t0, t1
+    sw zero, 0(t0)
+    lw s0, 8(sp)
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    li a0, 0
+    ret
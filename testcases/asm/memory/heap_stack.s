@@ -0,0 +1,38 @@
+# The heap grown as close to the stack as it may be, then a recursion
+# far deeper than the default 32 KiB stack.
+# Expected: Stack overflow, not a silent write into the heap.
+    .text
+    .align    2
+    .globl    main
+main:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    sw s0, 8(sp)
+    # The heap may end up to 64 KiB below the 32 KiB stack.
+    # Grow it to about 256 bytes short of that.
+    li a0, 16
+    call malloc
+    addi t0, sp, 16
+    li t1, 0x18100
+    sub t0, t0, t1
+    sub a0, t0, a0
+    call malloc
+    mv s0, a0
+    li a0, 3000
+    call deep
+    lw s0, 8(sp)
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    li a0, 42
+    ret
+
+deep:
+    addi sp, sp, -32
+    sw ra, 28(sp)
+    beqz a0, .done
+    addi a0, a0, -1
+    call deep
+.done:
+    lw ra, 28(sp)
+    addi sp, sp, 32
+    ret
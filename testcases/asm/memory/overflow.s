@@ -0,0 +1,24 @@
+# Recursion far deeper than the default 32 KiB stack.
+# Expected: Stack overflow, in the local function deep.
+    .text
+    .align    2
+    .globl    main
+main:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    li a0, 3000
+    call deep
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    ret
+
+deep:
+    addi sp, sp, -32
+    sw ra, 28(sp)
+    beqz a0, .done
+    addi a0, a0, -1
+    call deep
+.done:
+    lw ra, 28(sp)
+    addi sp, sp, 32
+    ret
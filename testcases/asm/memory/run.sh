@@ -0,0 +1 @@
+reimu -f=$1 -o="<stdout>" --silent
\ No newline at end of file
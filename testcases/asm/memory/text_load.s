@@ -0,0 +1,10 @@
+# A load from the text section.
+# Expected: Load out of bound, with guard pages or not.
+    .text
+    .align    2
+    .globl    main
+main:
+    la t0, main
+    lw a0, 0(t0)
+    li a0, 0
+    ret
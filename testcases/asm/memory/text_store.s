@@ -0,0 +1,10 @@
+# A store into the text section.
+# Expected: Store out of bound, with guard pages or not.
+    .text
+    .align    2
+    .globl    main
+main:
+    la t0, main
+    sw a0, 0(t0)
+    li a0, 0
+    ret
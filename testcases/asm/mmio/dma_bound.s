@@ -0,0 +1,18 @@
+# Write out a buffer through the DMA which runs past the end of the data.
+# Options:
+# Expect: Load out of bound at 0x11000 | size = 4096
+    .text
+    .align    2
+    .globl    main
+main:
+    li t0, 0x1010
+    li t1, 4096
+    sw t1, 4(t0)
+    la t1, .str
+    sw t1, 0(t0)
+    li a0, 0
+    ret
+
+    .section .rodata
+.str:
+    .asciz "never written out\n"
@@ -0,0 +1,34 @@
+# Write a line through the UART a byte at a time, then one through the DMA.
+# Each of the 6 accesses counts as libcIO, with a weight of 8 per byte.
+# Options:
+# Expect: uart
+# Expect: dma output
+# Expect: Exit code: 0
+# Expect: Total cycles: 1041
+# Expect: # libcIO   = 6
+    .text
+    .align    2
+    .globl    main
+main:
+    li t0, 0x1000
+    la t1, .uart
+.loop:
+    lbu t2, 0(t1)
+    beqz t2, .done
+    sb t2, 0(t0)
+    addi t1, t1, 1
+    j .loop
+.done:
+    li t0, 0x1010
+    li t1, 11
+    sw t1, 4(t0)
+    la t1, .dma
+    sw t1, 0(t0)
+    li a0, 0
+    ret
+
+    .section .rodata
+.uart:
+    .asciz "uart\n"
+.dma:
+    .asciz "dma output\n"
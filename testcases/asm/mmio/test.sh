@@ -0,0 +1 @@
+REIMU=${REIMU:-reimu} sh ../check.sh *.s
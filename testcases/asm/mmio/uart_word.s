@@ -0,0 +1,12 @@
+# A word store to the UART, which is only one byte wide.
+# Options:
+# Expect: Store out of bound at 0x1000 | size = 4
+    .text
+    .align    2
+    .globl    main
+main:
+    li t0, 0x1000
+    li t1, 0x0a414141
+    sw t1, 0(t0)
+    li a0, 0
+    ret
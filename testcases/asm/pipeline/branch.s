@@ -0,0 +1,35 @@
+# Taken branches and jumps, with no stall at all. Out of 100 runs, beqz is
+# taken 50 times, j 50 times, jal and the ret back 50 times each, and the
+# bnez back 99 times, so 299 flushes in all.
+# Options: --pipeline --detail
+# Expect: Exit code: 150
+# Expect: Pipeline stalls: 0, flushes: 299
+# Options: --pipeline --icache --detail
+# Expect: Exit code: 150
+# Expect: Pipeline stalls: 0, flushes: 299
+    .text
+    .align    2
+    .globl    main
+main:
+    mv s3, ra
+    li s0, 100
+    li s1, 0
+.loop:
+    andi t0, s0, 1
+    beqz t0, .even
+    addi s1, s1, 1
+    j .next
+.even:
+    mv a0, s1
+    jal .double
+    mv s1, a0
+.next:
+    addi s0, s0, -1
+    bnez s0, .loop
+    mv a0, s1
+    mv ra, s3
+    ret
+
+.double:
+    addi a0, a0, 2
+    ret
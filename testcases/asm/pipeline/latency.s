@@ -0,0 +1,37 @@
+# A multiply used right after it stalls twice, and a divide 9 times,
+# 100 times each. A multiply right before the jump back, used at the top
+# of the loop, stalls once each time it is jumped back to, i.e. 99 times.
+# So 200 + 900 + 99 = 1199 stalls, and 3 * 99 = 297 flushes in all.
+# Options: --pipeline --detail
+# Expect: Exit code: 671842
+# Expect: Pipeline stalls: 1199, flushes: 297
+# Options: --pipeline --icache --detail
+# Expect: Exit code: 671842
+# Expect: Pipeline stalls: 1199, flushes: 297
+    .text
+    .align    2
+    .globl    main
+main:
+    li s0, 100
+    li s1, 0
+    li s3, 1000
+.multiply:
+    mul t1, s0, s0
+    add s1, s1, t1
+    addi s0, s0, -1
+    bnez s0, .multiply
+    li s0, 100
+.divide:
+    div t1, s3, s0
+    add s1, s1, t1
+    addi s0, s0, -1
+    bnez s0, .divide
+    li s0, 100
+    li t1, 0
+.across:
+    add s1, s1, t1
+    addi s0, s0, -1
+    mul t1, s0, s0
+    bnez s0, .across
+    mv a0, s1
+    ret
@@ -0,0 +1,31 @@
+# A load used right after it, 100 times, which stalls once each, and the
+# same loop with an independent instruction in between, which never does.
+# Each loop jumps back 99 times, so 100 stalls and 198 flushes in all.
+# Options: --pipeline --detail
+# Expect: Exit code: 600
+# Expect: Pipeline stalls: 100, flushes: 198
+# Options: --pipeline --icache --detail
+# Expect: Exit code: 600
+# Expect: Pipeline stalls: 100, flushes: 198
+    .text
+    .align    2
+    .globl    main
+main:
+    addi s2, sp, -16
+    li t1, 3
+    sw t1, 0(s2)
+    li s0, 100
+    li s1, 0
+.inside:
+    lw t1, 0(s2)
+    add s1, s1, t1
+    addi s0, s0, -1
+    bnez s0, .inside
+    li s0, 100
+.scheduled:
+    lw t1, 0(s2)
+    addi s0, s0, -1
+    add s1, s1, t1
+    bnez s0, .scheduled
+    mv a0, s1
+    ret
@@ -0,0 +1,30 @@
+# A branch taken every other time, in a loop of 2000 runs. Out of the 4000
+# branches, bimodal gets the loop branch right but only half of the other
+# one, while those with a global history get almost all of them.
+# Options: --predictor --bp=bimodal
+# Expect: Exit code: 1000
+# Expect: Branch prediction taken rate: 74.97% (2999/4000) by bimodal
+# Options: --predictor --bp=gshare
+# Expect: Exit code: 1000
+# Expect: Branch prediction taken rate: 99.88% (3995/4000) by gshare
+# Options: --predictor --bp=tournament
+# Expect: Exit code: 1000
+# Expect: Branch prediction taken rate: 99.88% (3995/4000) by tournament
+# Options: --predictor --bp=tage
+# Expect: Exit code: 1000
+# Expect: Branch prediction taken rate: 99.92% (3997/4000) by tage
+    .text
+    .align    2
+    .globl    main
+main:
+    li t0, 2000
+    li t1, 0
+.loop:
+    andi t2, t0, 1
+    beqz t2, .skip
+    addi t1, t1, 1
+.skip:
+    addi t0, t0, -1
+    bnez t0, .loop
+    mv a0, t1
+    ret
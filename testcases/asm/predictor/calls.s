@@ -0,0 +1,42 @@
+# Calls 3 deep, by jal, 100 times. All the 300 returns are predicted by the
+# return address stack, and only the return from main is not, since the
+# call into main is not simulated. All the 300 jal are predicted by the
+# target buffer, except the first one of each.
+# Options: --btb
+# Expect: Exit code: 100
+# Expect: Jump target prediction rate: 99.00% (297/300)
+# Expect: Return address prediction rate: 99.67% (300/301)
+    .text
+    .align    2
+    .globl    main
+main:
+    mv s3, ra
+    li s0, 100
+    li s1, 0
+.loop:
+    jal .first
+    addi s0, s0, -1
+    bnez s0, .loop
+    mv a0, s1
+    mv ra, s3
+    ret
+
+.first:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    jal .second
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    ret
+
+.second:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    jal .third
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    ret
+
+.third:
+    addi s1, s1, 1
+    ret
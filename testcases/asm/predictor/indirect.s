@@ -0,0 +1,42 @@
+# Indirect calls by jalr, 100 times to the same function, then 100 times
+# to one of two functions in turn. The target buffer keeps the last target
+# of each jalr, so it gets 99 of the first ones and none of the others.
+# All the 200 returns are predicted, except the one from main.
+# Options: --btb
+# Expect: Exit code: 250
+# Expect: Jump target prediction rate: 49.50% (99/200)
+# Expect: Return address prediction rate: 99.50% (200/201)
+    .text
+    .align    2
+    .globl    main
+main:
+    mv s3, ra
+    la s4, .one
+    la s5, .two
+    li s0, 100
+    li s1, 0
+.same:
+    jalr s4
+    addi s0, s0, -1
+    bnez s0, .same
+    li s0, 100
+.turn:
+    andi t0, s0, 1
+    mv t1, s4
+    beqz t0, .call
+    mv t1, s5
+.call:
+    jalr t1
+    addi s0, s0, -1
+    bnez s0, .turn
+    mv a0, s1
+    mv ra, s3
+    ret
+
+.one:
+    addi s1, s1, 1
+    ret
+
+.two:
+    addi s1, s1, 2
+    ret
@@ -0,0 +1,57 @@
+# Usage: sh cache.sh <reimu> [<reimu> ...]
+#
+# Generate a program whose hot loop is mostly loads and stores over a buffer,
+# then report the time taken by each binary without the cache, with the
+# default cache and with a larger two-level one.
+# The difference is the cost of the cache simulation on each access.
+
+size=${SIZE:-65536}
+rounds=${ROUNDS:-40}
+large=${LARGE:---l1d=size=32K,ways=8 --l2=size=256K,ways=16}
+source=$(mktemp --suffix=.s)
+
+awk -v size=$size -v rounds=$rounds 'BEGIN {
+    print "    .text"
+    print "    .globl main"
+    print "main:"
+    print "    addi sp, sp, -16"
+    print "    sw ra, 12(sp)"
+    print "    li a0, " size
+    print "    call malloc"
+    print "    mv s1, a0"
+    print "    li s0, " rounds
+    print "    li s2, " size - 64
+    print ".loop:"
+    print "    li t0, 0"
+    print ".inner:"
+    print "    add t1, s1, t0"
+    # Four lines apart, so that each group touches several lines.
+    for (i = 0; i < 4; i++) {
+        print "    lw t2, " i * 16 "(t1)"
+        print "    lw t3, " i * 16 + 4 "(t1)"
+        print "    add t2, t2, t3"
+        print "    sw t2, " i * 16 + 8 "(t1)"
+    }
+    print "    addi t0, t0, 64"
+    print "    blt t0, s2, .inner"
+    print "    addi s0, s0, -1"
+    print "    bnez s0, .loop"
+    print "    lw ra, 12(sp)"
+    print "    addi sp, sp, 16"
+    print "    li a0, 0"
+    print "    ret"
+}' > $source
+
+accesses=$(( size / 64 * 12 * rounds ))
+echo "Memory accesses: $accesses"
+
+for reimu in "$@"; do
+    for options in "" "--cache" "--cache $large"; do
+        start=$(date +%s%N)
+        $reimu -f=$source --silent $options > /dev/null 2>&1
+        end=$(date +%s%N)
+        echo "$reimu ${options:-(no cache)}: $(( (end - start) / 1000000 )) ms"
+    done
+done
+
+rm -f $source
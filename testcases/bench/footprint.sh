@@ -0,0 +1,57 @@
+# Usage: sh footprint.sh <reimu> <compact reimu>
+#
+# Generate a program whose hot loop walks over a large text section,
+# then report the decoded footprint and the time taken by each binary.
+# Build the first binary with `xmake f --compact=n` and the second with
+# `--compact=y`, which must take 16 and 8 bytes for each decoded command.
+
+functions=${FUNCTIONS:-512}
+length=${LENGTH:-128}
+rounds=${ROUNDS:-200}
+source=$(mktemp --suffix=.s)
+
+awk -v functions=$functions -v size=$length -v rounds=$rounds 'BEGIN {
+    print "    .text"
+    print "    .globl main"
+    for (i = 0; i < functions; i++) {
+        print "f" i ":"
+        for (j = 0; j < size; j++) {
+            if (j % 4 == 0)      print "    addi a0, a0, " (i + j) % 7
+            else if (j % 4 == 1) print "    xor a1, a1, a0"
+            else if (j % 4 == 2) print "    slli a2, a1, " j % 5
+            else                 print "    add a0, a0, a2"
+        }
+        print "    ret"
+    }
+    print "main:"
+    print "    addi sp, sp, -16"
+    print "    sw ra, 12(sp)"
+    print "    li s0, " rounds
+    print ".loop:"
+    for (i = 0; i < functions; i++) print "    call f" i
+    print "    addi s0, s0, -1"
+    print "    bnez s0, .loop"
+    print "    lw ra, 12(sp)"
+    print "    addi sp, sp, 16"
+    print "    li a0, 0"
+    print "    ret"
+}' > $source
+
+commands=$(( functions * (length + 1) + functions + 10 ))
+echo "Commands in text: $commands"
+
+status=0
+for pair in "$1 16" "$2 8"; do
+    set -- $pair
+    start=$(date +%s%N)
+    footprint=$($1 -f=$source --detail 2>&1 > /dev/null | grep -a "Decoded footprint")
+    end=$(date +%s%N)
+    echo "$1: $(( (end - start) / 1000000 )) ms, ${footprint#Decoded footprint: }"
+    if [ "${footprint#*(}" != "$2 bytes each)" ]; then
+        echo "\033[31m$1: expected $2 bytes for each decoded command\033[0m"
+        status=1
+    fi
+done
+
+rm -f $source
+exit $status
@@ -0,0 +1,80 @@
+# Usage: sh lru.sh <reimu>
+#
+# Generate programs of random loads and stores over a buffer, and check the
+# hits and the lines moved by the simulated L1D against a plain LRU list,
+# for numbers of ways on both sides of the packed age matrix (8 ways).
+
+reimu=$1
+count=${COUNT:-4000}
+sets=4
+line=16
+source=$(mktemp --suffix=.s)
+expected=$(mktemp)
+status=0
+
+for ways in 1 2 3 4 7 8 9 16 64; do
+    awk -v seed=$ways -v count=$count -v sets=$sets -v ways=$ways -v line=$line \
+        -v source=$source 'BEGIN {
+        srand(seed)
+        lines = sets * ways * 2
+        print "    .text" > source
+        print "    .globl main" > source
+        print "main:" > source
+        print "    la s0, buffer" > source
+        for (i = 0; i < count; i++) {
+            which = int(rand() * lines)
+            write = rand() < 0.5
+            print "    li t1, " which * line + int(rand() * line / 4) * 4 > source
+            print "    add t1, s0, t1" > source
+            print "    " (write ? "sw" : "lw") " t2, 0(t1)" > source
+
+            # The reference: each set is a list from the least recently used.
+            set = which % sets
+            size = length_of[set] + 0
+            found = -1
+            for (j = 0; j < size; j++)
+                if (list[set, j] == which)
+                    found = j
+            if (found >= 0) {
+                hits++
+                dirty[which] = dirty[which] || write
+            } else {
+                fills++
+                if (size == ways) {
+                    written += dirty[list[set, 0]]
+                    found = 0
+                } else {
+                    found = size++
+                    length_of[set] = size
+                    list[set, found] = which
+                }
+                dirty[which] = write
+            }
+            for (j = found; j + 1 < size; j++)
+                list[set, j] = list[set, j + 1]
+            list[set, size - 1] = which
+        }
+        print "    li a0, 0" > source
+        print "    ret" > source
+        print "    .bss" > source
+        print "    .align 12" > source
+        print "buffer:" > source
+        print "    .zero " lines * line > source
+        printf "Cache hit rate: %.2f%% (%d/%d)\n", hits * 100 / count, hits, count
+        printf "Cache lines from memory: %d, to memory: %d\n", fills, written
+    }' > $expected
+
+    options="--cache --l1d=size=$((sets * ways * line)),ways=$ways,line=$line"
+    actual=$($reimu -f=$source -o=/dev/null $options 2>&1 | grep -a "^Cache")
+    if [ "$actual" = "$(cat $expected)" ]; then
+        echo "\033[32mways = $ways: ok\033[0m"
+    else
+        echo "\033[31mways = $ways: mismatch\033[0m"
+        echo "expected:"; cat $expected
+        echo "actual:"; echo "$actual"
+        status=1
+    fi
+done
+
+rm -f $source $expected
+exit $status
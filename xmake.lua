@@ -14,6 +14,35 @@ local other_cxflags = {
     "-Wno-gnu-zero-variadic-macro-arguments" -- disable warning on this
 }
 
+option("threaded")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Dispatch instructions by direct tail calls instead of a loop")
+    add_defines("REIMU_THREADED_DISPATCH")
+option_end()
+
+option("jit")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Translate hot blocks into native code (x86-64 Linux only)")
+    add_defines("REIMU_JIT")
+option_end()
+
+option("guard")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Catch out-of-bound accesses by guard pages instead of range checks (Linux only)")
+    add_defines("REIMU_GUARD_PAGES")
+    add_cxflags("-fnon-call-exceptions")
+option_end()
+
+option("compact")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Use 8-byte decoded commands, with handlers in a side table")
+    add_defines("REIMU_COMPACT_EXECUTABLE")
+option_end()
+
 target("reimu")
     set_kind("binary")
     set_warnings(warnings)
@@ -23,3 +52,5 @@ target("reimu")
     add_files("src/main.cpp")
     set_languages("c++23")
     add_packages("fmt")
+    add_syslinks("pthread")
+    add_options("threaded", "jit", "compact", "guard")